@@ -4,17 +4,35 @@
 void build() {
     command_t * cmd = command_init(CC);
     command_add_source_file(cmd, "src/main.c");
+    command_add_source_file(cmd, "src/async_io.c");
+    command_add_source_file(cmd, "src/atlas.c");
+    command_add_source_file(cmd, "src/batch.c");
+    command_add_source_file(cmd, "src/bc.c");
+    command_add_source_file(cmd, "src/geometry_heap.c");
     command_add_source_file(cmd, "src/glad.c");
+    command_add_source_file(cmd, "src/gltf.c");
     command_add_source_file(cmd, "src/debug.c");
+    command_add_source_file(cmd, "src/draw_commands.c");
+    command_add_source_file(cmd, "src/gl_state.c");
     command_add_source_file(cmd, "src/io.c");
+    command_add_source_file(cmd, "src/json.c");
+    command_add_source_file(cmd, "src/mesh_file.c");
+    command_add_source_file(cmd, "src/mesh_optimizer.c");
+    command_add_source_file(cmd, "src/mipmap.c");
+    command_add_source_file(cmd, "src/obj.c");
+    command_add_source_file(cmd, "src/pool.c");
     command_add_source_file(cmd, "src/shader.c");
     command_add_source_file(cmd, "src/shape.c");
     command_add_source_file(cmd, "src/stb_image.c");
+    command_add_source_file(cmd, "src/stream_buffer.c");
     command_add_source_file(cmd, "src/texture.c");
+    command_add_source_file(cmd, "src/texture_cache.c");
+    command_add_source_file(cmd, "src/vertex_layout.c");
     command_add_include_dir(cmd, "include");
     command_add_dynamic_library(cmd, "glfw");
     command_add_dynamic_library(cmd, "GL");
     command_add_dynamic_library(cmd, "m");
+    command_add_dynamic_library(cmd, "pthread");
     command_append(cmd, "-fmax-include-depth=300");
     command_set_output_file(cmd, "build/main");
     command_execute(cmd);
@@ -5,27 +5,41 @@
 
 typedef struct allocator_t allocator_t;
 
+// m_context is handed back to every entry point, so allocators can carry state
 struct allocator_t {
-    void * (*m_alloc)(size_t size);
-    void * (*m_clean_alloc)(size_t n, size_t size);
-    void * (*m_realloc)(void * p, size_t size);
-    void (*m_free)(void * p);
+    void * m_context;
+    void * (*m_alloc)(void * context, size_t size);
+    void * (*m_clean_alloc)(void * context, size_t n, size_t size);
+    void * (*m_realloc)(void * context, void * p, size_t size);
+    void (*m_free)(void * context, void * p);
+    void (*m_free_sized)(void * context, void * p, size_t size); // optional, m_free is used if NULL
+    void * (*m_aligned_alloc)(void * context, size_t alignment, size_t size); // alignment is a power of 2, freed with m_free
 };
 
 static inline void * allocator_alloc(allocator_t * self, size_t size) {
-    return self->m_alloc(size);
+    return self->m_alloc(self->m_context, size);
 }
 
 static inline void * allocator_clean_alloc(allocator_t * self, size_t n, size_t size) {
-    return self->m_clean_alloc(n, size);
+    return self->m_clean_alloc(self->m_context, n, size);
 }
 
 static inline void * allocator_realloc(allocator_t * self, void * p, size_t size) {
-    return self->m_realloc(p, size);
+    return self->m_realloc(self->m_context, p, size);
 }
 
 static inline void allocator_free(allocator_t * self, void * p) {
-    self->m_free(p);
+    self->m_free(self->m_context, p);
+}
+
+// size must be the size the block was allocated with
+static inline void allocator_free_sized(allocator_t * self, void * p, size_t size) {
+    if(self->m_free_sized) self->m_free_sized(self->m_context, p, size);
+    else self->m_free(self->m_context, p);
+}
+
+static inline void * allocator_aligned_alloc(allocator_t * self, size_t alignment, size_t size) {
+    return self->m_aligned_alloc(self->m_context, alignment, size);
 }
 #endif
 
@@ -34,11 +48,250 @@ static inline void allocator_free(allocator_t * self, void * p) {
 #ifndef _ALLOCATOR_HEAP_ALLOCATOR
 #define _ALLOCATOR_HEAP_ALLOCATOR
 #include <stdlib.h>
+static inline void * _allocator_heap_alloc(void * context, size_t size) {
+    (void)context;
+    return malloc(size);
+}
+
+static inline void * _allocator_heap_clean_alloc(void * context, size_t n, size_t size) {
+    (void)context;
+    return calloc(n, size);
+}
+
+static inline void * _allocator_heap_realloc(void * context, void * p, size_t size) {
+    (void)context;
+    return realloc(p, size);
+}
+
+static inline void _allocator_heap_free(void * context, void * p) {
+    (void)context;
+    free(p);
+}
+
+static inline void * _allocator_heap_aligned_alloc(void * context, size_t alignment, size_t size) {
+    (void)context;
+    if(alignment <= sizeof(void *) * 2) return malloc(size);
+    // aligned_alloc wants the size to be a multiple of the alignment
+    return aligned_alloc(alignment, (size + alignment - 1) & ~(alignment - 1));
+}
+
 static inline void allocator_new_heap_allocator(allocator_t * self) {
-    self->m_alloc = &malloc;
-    self->m_clean_alloc = &calloc;
-    self->m_realloc = &realloc;
-    self->m_free = &free;
+    self->m_context = NULL;
+    self->m_alloc = &_allocator_heap_alloc;
+    self->m_clean_alloc = &_allocator_heap_clean_alloc;
+    self->m_realloc = &_allocator_heap_realloc;
+    self->m_free = &_allocator_heap_free;
+    self->m_free_sized = NULL;
+    self->m_aligned_alloc = &_allocator_heap_aligned_alloc;
+}
+#endif
+#endif
+
+
+#if defined(ALLOCATOR_ARENA_ALLOCATOR) || defined(ALLOCATOR_FRAME_ALLOCATOR)
+#ifndef _ALLOCATOR_ARENA_ALLOCATOR
+#define _ALLOCATOR_ARENA_ALLOCATOR
+#include <stdint.h>
+#include <string.h>
+
+// Every allocation handed out by an arena is aligned to this
+#define ALLOCATOR_ARENA_ALIGNMENT 16
+
+typedef struct arena_t arena_t;
+
+// Bump pointer allocator over one block taken from a backing allocator.
+// Every allocation is preceded by its size so realloc can copy, only the
+// most recent allocation can be grown in place or given back with free.
+struct arena_t {
+    allocator_t * backing;
+    unsigned char * base;
+    size_t capacity;
+    size_t offset;
+    size_t last_start; // offset before the most recent allocation
+    unsigned char * last; // most recent allocation, NULL if it was freed
+    size_t high_water; // largest offset ever reached
+};
+
+static inline void arena_init(arena_t * arena, allocator_t * backing, size_t capacity) {
+    arena->backing = backing;
+    arena->base = (unsigned char *)allocator_alloc(backing, capacity);
+    arena->capacity = arena->base ? capacity : 0;
+    arena->offset = 0;
+    arena->last_start = 0;
+    arena->last = NULL;
+    arena->high_water = 0;
+}
+
+static inline void arena_deinit(arena_t * arena) {
+    allocator_free(arena->backing, arena->base);
+    arena->base = NULL;
+    arena->capacity = 0;
+}
+
+// O(1), everything allocated from the arena is invalidated
+static inline void arena_reset(arena_t * arena) {
+    arena->offset = 0;
+    arena->last_start = 0;
+    arena->last = NULL;
+}
+
+static inline void * arena_aligned_alloc(arena_t * arena, size_t alignment, size_t size) {
+    if(alignment < ALLOCATOR_ARENA_ALIGNMENT) alignment = ALLOCATOR_ARENA_ALIGNMENT;
+    uintptr_t start = (uintptr_t)arena->base + arena->offset + sizeof(size_t);
+    uintptr_t p = (start + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    size_t end = (size_t)(p - (uintptr_t)arena->base);
+    if(end > arena->capacity || size > arena->capacity - end) return NULL;
+
+    ((size_t *)p)[-1] = size;
+    arena->last_start = arena->offset;
+    arena->last = (unsigned char *)p;
+    arena->offset = end + size;
+    if(arena->offset > arena->high_water) arena->high_water = arena->offset;
+    return (void *)p;
+}
+
+static inline void * arena_alloc(arena_t * arena, size_t size) {
+    return arena_aligned_alloc(arena, ALLOCATOR_ARENA_ALIGNMENT, size);
+}
+
+static inline void * arena_clean_alloc(arena_t * arena, size_t n, size_t size) {
+    if(size && n > SIZE_MAX / size) return NULL;
+    void * p = arena_alloc(arena, n * size);
+    if(p) memset(p, 0, n * size);
+    return p;
+}
+
+static inline void * arena_realloc(arena_t * arena, void * p, size_t size) {
+    if(!p) return arena_alloc(arena, size);
+
+    size_t old_size = ((size_t *)p)[-1];
+    if(p == arena->last) {
+        size_t start = (size_t)((unsigned char *)p - arena->base);
+        if(size > arena->capacity - start) return NULL;
+        ((size_t *)p)[-1] = size;
+        arena->offset = start + size;
+        if(arena->offset > arena->high_water) arena->high_water = arena->offset;
+        return p;
+    }
+    if(size <= old_size) {
+        ((size_t *)p)[-1] = size;
+        return p;
+    }
+
+    void * q = arena_alloc(arena, size);
+    if(q) memcpy(q, p, old_size);
+    return q;
+}
+
+static inline void arena_free(arena_t * arena, void * p) {
+    if(p && p == arena->last) {
+        arena->offset = arena->last_start;
+        arena->last = NULL;
+    }
+}
+
+static inline void * _allocator_arena_alloc(void * context, size_t size) {
+    return arena_alloc((arena_t *)context, size);
+}
+
+static inline void * _allocator_arena_clean_alloc(void * context, size_t n, size_t size) {
+    return arena_clean_alloc((arena_t *)context, n, size);
+}
+
+static inline void * _allocator_arena_realloc(void * context, void * p, size_t size) {
+    return arena_realloc((arena_t *)context, p, size);
+}
+
+static inline void _allocator_arena_free(void * context, void * p) {
+    arena_free((arena_t *)context, p);
+}
+
+static inline void * _allocator_arena_aligned_alloc(void * context, size_t alignment, size_t size) {
+    return arena_aligned_alloc((arena_t *)context, alignment, size);
+}
+
+static inline void allocator_new_arena_allocator(allocator_t * self, arena_t * arena) {
+    self->m_context = arena;
+    self->m_alloc = &_allocator_arena_alloc;
+    self->m_clean_alloc = &_allocator_arena_clean_alloc;
+    self->m_realloc = &_allocator_arena_realloc;
+    self->m_free = &_allocator_arena_free;
+    self->m_free_sized = NULL;
+    self->m_aligned_alloc = &_allocator_arena_aligned_alloc;
+}
+#endif
+#endif
+
+
+#ifdef ALLOCATOR_FRAME_ALLOCATOR
+#ifndef _ALLOCATOR_FRAME_ALLOCATOR
+#define _ALLOCATOR_FRAME_ALLOCATOR
+
+typedef struct frame_allocator_t frame_allocator_t;
+
+// Two arenas used on alternate frames, an allocation stays valid until the
+// end of the frame after the one it was made in
+struct frame_allocator_t {
+    arena_t arenas[2];
+    unsigned int current;
+};
+
+static inline void frame_allocator_init(frame_allocator_t * frame, allocator_t * backing, size_t capacity_per_frame) {
+    arena_init(&frame->arenas[0], backing, capacity_per_frame);
+    arena_init(&frame->arenas[1], backing, capacity_per_frame);
+    frame->current = 0;
+}
+
+static inline void frame_allocator_deinit(frame_allocator_t * frame) {
+    arena_deinit(&frame->arenas[0]);
+    arena_deinit(&frame->arenas[1]);
+}
+
+// O(1), releases everything allocated two frames ago
+static inline void frame_allocator_begin_frame(frame_allocator_t * frame) {
+    frame->current ^= 1;
+    arena_reset(&frame->arenas[frame->current]);
+}
+
+static inline size_t frame_allocator_high_water(frame_allocator_t * frame) {
+    size_t a = frame->arenas[0].high_water;
+    size_t b = frame->arenas[1].high_water;
+    return a > b ? a : b;
+}
+
+static inline arena_t * _allocator_frame_arena(void * context) {
+    frame_allocator_t * frame = (frame_allocator_t *)context;
+    return &frame->arenas[frame->current];
+}
+
+static inline void * _allocator_frame_alloc(void * context, size_t size) {
+    return arena_alloc(_allocator_frame_arena(context), size);
+}
+
+static inline void * _allocator_frame_clean_alloc(void * context, size_t n, size_t size) {
+    return arena_clean_alloc(_allocator_frame_arena(context), n, size);
+}
+
+static inline void * _allocator_frame_realloc(void * context, void * p, size_t size) {
+    return arena_realloc(_allocator_frame_arena(context), p, size);
+}
+
+static inline void _allocator_frame_free(void * context, void * p) {
+    arena_free(_allocator_frame_arena(context), p);
+}
+
+static inline void * _allocator_frame_aligned_alloc(void * context, size_t alignment, size_t size) {
+    return arena_aligned_alloc(_allocator_frame_arena(context), alignment, size);
+}
+
+static inline void allocator_new_frame_allocator(allocator_t * self, frame_allocator_t * frame) {
+    self->m_context = frame;
+    self->m_alloc = &_allocator_frame_alloc;
+    self->m_clean_alloc = &_allocator_frame_clean_alloc;
+    self->m_realloc = &_allocator_frame_realloc;
+    self->m_free = &_allocator_frame_free;
+    self->m_free_sized = NULL;
+    self->m_aligned_alloc = &_allocator_frame_aligned_alloc;
 }
 #endif
 #endif
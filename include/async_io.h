@@ -0,0 +1,68 @@
+#ifndef ASYNC_IO_H_
+#define ASYNC_IO_H_
+
+#include <stddef.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "allocator.h"
+
+typedef struct async_io_t async_io_t;
+typedef struct async_io_request_t async_io_request_t;
+
+typedef enum async_io_priority_t {
+    ASYNC_IO_PRIORITY_HIGH,
+    ASYNC_IO_PRIORITY_NORMAL,
+    ASYNC_IO_PRIORITY_LOW,
+    ASYNC_IO_PRIORITY_COUNT,
+} async_io_priority_t;
+
+// Runs on a worker right after the file was read, for CPU work like decoding
+typedef void (*async_io_process_t)(async_io_request_t * request);
+// Runs on the thread calling async_io_poll
+typedef void (*async_io_complete_t)(async_io_request_t * request);
+
+// data is 0 terminated and freed after complete returns, set it to NULL to keep it
+struct async_io_request_t {
+    async_io_t * io;
+    const char * path;
+    async_io_priority_t priority;
+    async_io_process_t process;
+    async_io_complete_t complete;
+    void * user;
+    char * data;
+    size_t size;
+    void * result; // free for process to fill in
+    async_io_request_t * next;
+};
+
+// Workers take the highest priority request first. Finished requests are
+// pushed on a lock free stack the owning thread drains in async_io_poll.
+// The allocator is used from the workers, so it has to be thread safe.
+struct async_io_t {
+    allocator_t * a;
+    pthread_t * workers;
+    unsigned int worker_count;
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;
+    async_io_request_t * pending_head[ASYNC_IO_PRIORITY_COUNT];
+    async_io_request_t * pending_tail[ASYNC_IO_PRIORITY_COUNT];
+    int stopping;
+    _Atomic(async_io_request_t *) completed;
+    atomic_uint in_flight;
+};
+
+// worker_count 0 starts one worker per core
+void async_io_init(async_io_t * io, unsigned int worker_count, allocator_t * a);
+// Finishes every request that was submitted, completions included
+void async_io_deinit(async_io_t * io);
+async_io_request_t * async_io_read(async_io_t * io, const char * path, async_io_priority_t priority, async_io_process_t process, async_io_complete_t complete, void * user);
+// Like async_io_read for bytes already in memory, they are copied so the caller can free them.
+// name takes the place of the path in the request.
+async_io_request_t * async_io_submit(async_io_t * io, const char * name, const void * data, size_t size, async_io_priority_t priority, async_io_process_t process, async_io_complete_t complete, void * user);
+// Runs the completions of every finished request, returns how many there were
+unsigned int async_io_poll(async_io_t * io);
+// Polls until nothing is in flight
+void async_io_flush(async_io_t * io);
+unsigned int async_io_in_flight(async_io_t * io);
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef ATLAS_H_
+#define ATLAS_H_
+
+#include "allocator.h"
+#include "texture.h"
+
+#define ATLAS_MAX_PAGES 16
+
+typedef struct atlas_region_t atlas_region_t;
+typedef struct atlas_node_t atlas_node_t;
+typedef struct atlas_page_t atlas_page_t;
+typedef struct atlas_t atlas_t;
+
+// Where an image ended up, x/y/width/height in texels of the page, without the padding
+struct atlas_region_t {
+    int page;
+    int x;
+    int y;
+    int width;
+    int height;
+    float u0;
+    float v0;
+    float u1;
+    float v1;
+};
+
+// One segment of the skyline, the top of everything packed below it
+struct atlas_node_t {
+    int x;
+    int y;
+    int width;
+};
+
+struct atlas_page_t {
+    texture_t texture; // 0 until the page is first uploaded
+    unsigned char * pixels;
+    atlas_node_t * skyline;
+    int node_count;
+    int dirty;
+};
+
+// Packs images into square RGBA8 pages with the skyline bottom left
+// heuristic. Every image is surrounded by padding texels that repeat its
+// edges, so filtering does not bleed in the neighbours. A padding of P
+// texels only keeps the first floor(log2(P)) mip levels below the base
+// clean, the chain is cut off there.
+struct atlas_t {
+    allocator_t * a;
+    int page_size;
+    int padding;
+    int srgb; // pages hold sRGB colours, stored as GL_SRGB8_ALPHA8 and filtered in linear space
+    atlas_page_t pages[ATLAS_MAX_PAGES];
+    int page_count;
+};
+
+void atlas_init(atlas_t * atlas, int page_size, int padding, int srgb, allocator_t * a);
+void atlas_deinit(atlas_t * atlas);
+// Returns 0 if the image does not fit on an empty page or every page is full
+int atlas_add_image(atlas_t * atlas, const texture_image_t * image, atlas_region_t * region);
+int atlas_add_file(atlas_t * atlas, const char * path, atlas_region_t * region);
+// Uploads the pages that changed since the last upload, with mipmaps as far as the padding allows
+void atlas_upload(atlas_t * atlas, int mipmaps);
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include "glad/glad.h"
+#include "allocator.h"
+#include "shape.h"
+#include "shader.h"
+#include "texture.h"
+#include <stdint.h>
+
+// Quads sharing the 16 bit index buffer in one draw, 4 vertices each
+#define BATCH_QUADS_PER_DRAW 16384
+// Distinct program and texture pairs per flush, one more flushes first
+#define BATCH_MAX_STATES 256
+
+typedef struct batch_vertex_t batch_vertex_t;
+typedef struct batch_quad_t batch_quad_t;
+typedef struct batch_state_t batch_state_t;
+typedef struct batch_stats_t batch_stats_t;
+typedef struct batch_t batch_t;
+
+// Matches shaders/batch_vertex.glsl
+struct batch_vertex_t {
+    float x;
+    float y;
+    float u;
+    float v;
+    uint8_t colour[4];
+    float layer; // texture array layer, see texture_array_t
+};
+
+struct batch_quad_t {
+    batch_vertex_t vertices[4];
+    uint32_t state;
+};
+
+struct batch_state_t {
+    shader_program_t program;
+    GLenum target;
+    texture_t texture;
+};
+
+struct batch_stats_t {
+    unsigned int quads;
+    unsigned int draws;
+    unsigned int flushes;
+};
+
+// Collects quads on the CPU and draws them with as few calls as the
+// program and texture changes allow. Quads are grouped by state, the states
+// drawn ordered by program and then texture, and keep their order within a
+// state, so overlapping translucent quads of different states need a flush
+// in between.
+struct batch_t {
+    allocator_t * a;
+    shape_t shape; // EBO holds the shared quad indices
+    batch_quad_t * quads;
+    batch_vertex_t * vertices; // quads in draw order, staged for the upload
+    unsigned int quad_count;
+    unsigned int capacity;
+    size_t buffer_size;
+    batch_state_t states[BATCH_MAX_STATES];
+    unsigned int state_count;
+    unsigned int current_state;
+    batch_stats_t frame;
+    batch_stats_t last_frame;
+};
+
+// capacity is how many quads fit before the arrays grow
+void batch_init(batch_t * batch, unsigned int capacity, allocator_t * a);
+void batch_deinit(batch_t * batch);
+// Quads added afterwards, flushes included, are drawn with program and texture, bound to unit 0
+void batch_set_state(batch_t * batch, shader_program_t program, GLenum target, texture_t texture);
+// uv holds u0, v0, u1, v1, colour is RGBA
+void batch_quad(batch_t * batch, float x, float y, float width, float height, const float uv[4], const uint8_t colour[4], float layer);
+void batch_quad_vertices(batch_t * batch, const batch_vertex_t vertices[4]);
+void batch_flush(batch_t * batch);
+// Closes the frame, its counters are kept for batch_get_stats and the running ones are reset
+void batch_end_frame(batch_t * batch);
+batch_stats_t batch_get_stats(batch_t * batch);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef BC_H_
+#define BC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "glad/glad.h"
+#include "texture.h"
+
+// Not part of core 3.3, exposed by EXT_texture_compression_s3tc, EXT_texture_sRGB and ARB_texture_compression_bptc
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#define GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM 0x8E8D
+#endif
+
+typedef enum bc_format_t {
+    BC_FORMAT_BC1, // RGB, 4 bits per texel
+    BC_FORMAT_BC3, // RGBA, 8 bits per texel
+    BC_FORMAT_BC4, // R, 4 bits per texel
+    BC_FORMAT_BC5, // RG, 8 bits per texel
+    BC_FORMAT_BC7, // RGBA, 8 bits per texel, mode 6 only
+    BC_FORMAT_COUNT,
+} bc_format_t;
+
+size_t bc_block_size(bc_format_t format);
+size_t bc_image_size(bc_format_t format, int width, int height);
+GLenum bc_gl_format(bc_format_t format, int srgb);
+
+// Encodes an RGBA8 image, edge texels are repeated to fill partial blocks.
+// Rows of blocks are split over thread_count threads, 0 uses one per core.
+void bc_encode(bc_format_t format, const texture_image_t * image, unsigned char * out, unsigned int thread_count);
+
+void bc_encode_block_bc1(const unsigned char * rgba, unsigned char * out);
+void bc_encode_block_bc3(const unsigned char * rgba, unsigned char * out);
+void bc_encode_block_bc4(const unsigned char * rgba, int channel, unsigned char * out);
+void bc_encode_block_bc5(const unsigned char * rgba, unsigned char * out);
+void bc_encode_block_bc7(const unsigned char * rgba, unsigned char * out);
+
+#endif
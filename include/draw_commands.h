@@ -0,0 +1,55 @@
+#ifndef DRAW_COMMANDS_H_
+#define DRAW_COMMANDS_H_
+
+#include "glad/glad.h"
+#include "allocator.h"
+#include "shape.h"
+#include "shader.h"
+#include <stdint.h>
+
+// Not part of core 3.3, exposed by ARB_draw_indirect
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+typedef struct draw_command_t draw_command_t;
+typedef struct draw_commands_t draw_commands_t;
+
+// Laid out as GL reads it from GL_DRAW_INDIRECT_BUFFER
+struct draw_command_t {
+    uint32_t count;
+    uint32_t instance_count;
+    uint32_t first_index;
+    int32_t base_vertex;
+    uint32_t base_instance;
+};
+
+// Draws recorded for one VAO, such as a geometry heap, and submitted with
+// one glMultiDrawElementsIndirect where the context has it. Elsewhere each
+// command is drawn in a loop, which still saves the per object work of the
+// caller but not the per draw cost in the driver.
+struct draw_commands_t {
+    allocator_t * a;
+    draw_command_t * commands;
+    unsigned int count;
+    unsigned int capacity;
+    unsigned int buffer; // 0 until the first indirect submit
+    size_t buffer_size;
+};
+
+// Loads the entry points past GL 3.3 the submission can use, load is the
+// same function handed to gladLoadGLLoader. Returns 1 if draws are submitted
+// indirectly, needing GL 4.3 or ARB_multi_draw_indirect.
+int draw_commands_load(GLADloadproc load);
+void draw_commands_init(draw_commands_t * commands, unsigned int capacity, allocator_t * a);
+void draw_commands_deinit(draw_commands_t * commands);
+void draw_commands_reset(draw_commands_t * commands);
+void draw_commands_add(draw_commands_t * commands, const draw_command_t * command);
+// base_instance offsets the per instance attributes of the draw. The shape has to use 32 bit indices.
+void draw_commands_add_shape(draw_commands_t * commands, shape_t * shape, unsigned int instance_count, unsigned int base_instance);
+// Draws every command from vertex_array, which all shapes recorded have to share. Without
+// GL 4.2 the per instance attributes cannot be offset, then base_instance is written to
+// base_instance_uniform of program before each draw instead, if it is not -1.
+void draw_commands_submit(draw_commands_t * commands, unsigned int vertex_array, shader_program_t program, shader_uniform_t base_instance_uniform);
+
+#endif
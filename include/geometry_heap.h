@@ -0,0 +1,74 @@
+#ifndef GEOMETRY_HEAP_H_
+#define GEOMETRY_HEAP_H_
+
+#include "glad/glad.h"
+#include "allocator.h"
+#include "shape.h"
+#include "vertex_layout.h"
+
+#define GEOMETRY_HEAP_SET_MAX_LAYOUTS 32
+
+typedef struct geometry_range_t geometry_range_t;
+typedef struct geometry_range_list_t geometry_range_list_t;
+typedef struct geometry_allocation_t geometry_allocation_t;
+typedef struct geometry_heap_t geometry_heap_t;
+typedef struct geometry_heap_set_t geometry_heap_set_t;
+
+struct geometry_range_t {
+    unsigned int start;
+    unsigned int count;
+};
+
+// Free ranges sorted by start, neighbours are merged
+struct geometry_range_list_t {
+    geometry_range_t * ranges;
+    unsigned int count;
+    unsigned int capacity;
+};
+
+// Where a mesh lives in the heap, in vertices and indices
+struct geometry_allocation_t {
+    geometry_range_t vertices;
+    geometry_range_t indices;
+};
+
+// Static meshes of one vertex layout sub-allocated from one VBO and EBO,
+// behind one VAO. Shapes added to the heap draw with a base vertex and a
+// first index, so drawing every mesh of a layout needs a single VAO bind.
+// The buffers grow by copying on the GPU and keep their names, so shapes
+// and attribute pointers stay valid.
+struct geometry_heap_t {
+    allocator_t * a;
+    unsigned int VAO;
+    unsigned int VBO;
+    unsigned int EBO;
+    vertex_layout_t layout;
+    size_t stride;
+    unsigned int vertex_capacity;
+    unsigned int index_capacity;
+    geometry_range_list_t free_vertices;
+    geometry_range_list_t free_indices;
+};
+
+// One heap per layout in use, so layouts that compare equal share a VAO
+struct geometry_heap_set_t {
+    allocator_t * a;
+    unsigned int vertex_capacity;
+    unsigned int index_capacity;
+    geometry_heap_t heaps[GEOMETRY_HEAP_SET_MAX_LAYOUTS];
+    unsigned int count;
+};
+
+// Capacities are in vertices of the layout and in unsigned int indices
+void geometry_heap_init(geometry_heap_t * heap, const vertex_layout_t * layout, unsigned int vertex_capacity, unsigned int index_capacity, allocator_t * a);
+void geometry_heap_deinit(geometry_heap_t * heap);
+// Uploads the mesh and points shape at it, indices start at 0 for the first of its vertices
+geometry_allocation_t geometry_heap_add(geometry_heap_t * heap, shape_t * shape, void * vertices, unsigned int vertex_count, unsigned int * indices, unsigned int index_count);
+void geometry_heap_remove(geometry_heap_t * heap, geometry_allocation_t allocation);
+
+// Heaps are created on first use with the given capacities
+void geometry_heap_set_init(geometry_heap_set_t * set, unsigned int vertex_capacity, unsigned int index_capacity, allocator_t * a);
+void geometry_heap_set_deinit(geometry_heap_set_t * set);
+geometry_heap_t * geometry_heap_set_get(geometry_heap_set_t * set, const vertex_layout_t * layout);
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef GL_STATE_H_
+#define GL_STATE_H_
+
+#include "glad/glad.h"
+
+typedef struct gl_state_counter_t gl_state_counter_t;
+typedef struct gl_state_stats_t gl_state_stats_t;
+
+struct gl_state_counter_t {
+    unsigned int issued;
+    unsigned int elided;
+};
+
+struct gl_state_stats_t {
+    gl_state_counter_t programs;
+    gl_state_counter_t vertex_arrays;
+    gl_state_counter_t buffers;
+    gl_state_counter_t textures;
+};
+
+// Every bind goes through these, the driver is only called when the binding actually changes
+void gl_state_use_program(unsigned int program);
+void gl_state_bind_vertex_array(unsigned int vertex_array);
+void gl_state_bind_buffer(GLenum target, unsigned int buffer);
+// unit is the index of the unit, not GL_TEXTURE0 + index
+void gl_state_active_texture(unsigned int unit);
+void gl_state_bind_texture(GLenum target, unsigned int texture);
+void gl_state_bind_texture_unit(unsigned int unit, GLenum target, unsigned int texture);
+
+// Deleting a bound object unbinds it, these keep the cache in line with that
+void gl_state_forget_program(unsigned int program);
+void gl_state_forget_vertex_array(unsigned int vertex_array);
+void gl_state_forget_buffer(unsigned int buffer);
+void gl_state_forget_texture(unsigned int texture);
+
+// Call after binding anything behind the cache's back
+void gl_state_invalidate(void);
+
+// Closes the frame, its counters are kept for gl_state_get_stats and the running ones are reset
+void gl_state_end_frame(void);
+gl_state_stats_t gl_state_get_stats(void);
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef GLTF_H_
+#define GLTF_H_
+
+#include <stddef.h>
+#include "allocator.h"
+#include "shape.h"
+#include "texture.h"
+
+// Attribute locations of the loaded primitives
+#define GLTF_LOCATION_POSITION 0
+#define GLTF_LOCATION_TEXTURE_COORDINATE 1
+#define GLTF_LOCATION_NORMAL 2
+#define GLTF_LOCATION_COLOUR 3
+#define GLTF_LOCATION_TANGENT 4
+
+typedef struct gltf_primitive_t gltf_primitive_t;
+typedef struct gltf_mesh_t gltf_mesh_t;
+typedef struct gltf_material_t gltf_material_t;
+typedef struct gltf_node_t gltf_node_t;
+typedef struct gltf_t gltf_t;
+
+// The shape has its own VAO but reads from the buffers of gltf_t
+struct gltf_primitive_t {
+    shape_t shape;
+    int material; // -1 for the default material
+    int owns_indices; // EBO was generated for a primitive without indices
+};
+
+// primitives[first_primitive] to primitives[first_primitive + primitive_count - 1]
+struct gltf_mesh_t {
+    size_t first_primitive;
+    size_t primitive_count;
+};
+
+struct gltf_material_t {
+    float base_colour[4];
+    texture_t base_colour_texture; // 0 if there is none
+};
+
+// Matrices are column major
+struct gltf_node_t {
+    int parent; // index into gltf_t.nodes, -1 for roots
+    int mesh; // -1 if the node has none
+    int source; // index of the node in the file
+    float local[16];
+    float world[16];
+};
+
+// A loaded glTF 2.0 file, .gltf or .glb. Every buffer view read by
+// vertex attributes or indices is uploaded once, as it is in the file, into
+// its own GL buffer, and attributes point into it with the component type,
+// stride and offset of their accessor. Nothing is converted per vertex.
+// nodes holds the nodes of the scene depth first, parents always before
+// their children.
+struct gltf_t {
+    allocator_t * a;
+    unsigned int * buffers; // per buffer view, 0 for views no geometry reads
+    size_t buffer_count;
+    gltf_primitive_t * primitives;
+    size_t primitive_count;
+    gltf_mesh_t * meshes;
+    size_t mesh_count;
+    gltf_material_t * materials;
+    size_t material_count;
+    texture_t * images; // 0 for images that were not loaded
+    size_t image_count;
+    gltf_node_t * nodes;
+    size_t node_count;
+};
+
+// Images are decoded on the workers of loader, see texture_load_async, and can still be
+// placeholders when this returns. With loader NULL no image is loaded. Only triangle
+// primitives are kept. Panics on malformed files and on sparse accessors.
+void gltf_load(gltf_t * gltf, const char * path, texture_loader_t * loader, allocator_t * a);
+void gltf_free(gltf_t * gltf);
+// Recomputes every world matrix from the local ones, in one pass over nodes
+void gltf_update_world(gltf_t * gltf);
+
+#endif
@@ -1,8 +1,49 @@
 #ifndef IO_H_
 #define IO_H_
 
+#include <stddef.h>
 #include "allocator.h"
 
+typedef struct io_mapping_t io_mapping_t;
+typedef struct io_stream_t io_stream_t;
+
+typedef enum io_access_t {
+    IO_ACCESS_SEQUENTIAL,
+    IO_ACCESS_RANDOM,
+} io_access_t;
+
+// Read only view of a whole file, either mapped or, when mapping is not
+// possible, read into a buffer from a
+struct io_mapping_t {
+    const char * data;
+    size_t size;
+    int is_mapped;
+    allocator_t * a;
+};
+
+// Reads a file front to back in chunks into caller provided memory. The
+// kernel is asked to prefetch readahead chunks past the one being read and
+// to drop the ones already consumed, so memory use does not grow with the file
+struct io_stream_t {
+    int fd;
+    size_t size;
+    size_t offset;
+    size_t chunk_size;
+    unsigned int readahead;
+    size_t prefetched; // file offset up to which a prefetch was asked for
+};
+
+// The returned buffer is 0 terminated and allocated with a
 char * read_entire_file(const char * path, allocator_t * a);
+// Same as read_entire_file, size receives the size of the file without the terminator
+char * read_entire_file_sized(const char * path, size_t * size, allocator_t * a);
+
+void io_map_file(io_mapping_t * mapping, const char * path, io_access_t access, allocator_t * a);
+void io_unmap_file(io_mapping_t * mapping);
+
+void io_stream_open(io_stream_t * stream, const char * path, size_t chunk_size, unsigned int readahead);
+// Reads the next chunk, at most buffer_size bytes, returns the number of bytes read and 0 at the end of the file
+size_t io_stream_read(io_stream_t * stream, void * buffer, size_t buffer_size);
+void io_stream_close(io_stream_t * stream);
 
 #endif
@@ -0,0 +1,63 @@
+#ifndef JSON_H_
+#define JSON_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "allocator.h"
+
+#define JSON_NONE UINT32_MAX
+
+typedef struct json_value_t json_value_t;
+typedef struct json_t json_t;
+
+typedef enum json_type_t {
+    JSON_NULL,
+    JSON_FALSE,
+    JSON_TRUE,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY,
+    JSON_OBJECT,
+} json_type_t;
+
+// Strings and keys point into the parsed text, still escaped, so the text
+// has to outlive the json_t. Members of arrays and objects are linked
+// through first_child and next, indices into json_t.values.
+struct json_value_t {
+    json_type_t type;
+    uint32_t child_count;
+    uint32_t first_child;
+    uint32_t next;
+    const char * key; // for object members, NULL otherwise
+    size_t key_length;
+    const char * string;
+    size_t length;
+    double number;
+    int escaped; // string holds escapes, compare through json_string_copy
+};
+
+struct json_t {
+    allocator_t * a;
+    json_value_t * values; // values[0] is the root
+    size_t count;
+    size_t capacity;
+    const char * error; // why parsing failed, NULL if it did not
+    size_t error_offset;
+};
+
+// Returns 0 if text is not valid JSON, see error and error_offset
+int json_parse(json_t * json, const char * text, size_t length, allocator_t * a);
+void json_free(json_t * json);
+const json_value_t * json_root(const json_t * json);
+// NULL if object is NULL, not an object or has no member key
+const json_value_t * json_get(const json_t * json, const json_value_t * object, const char * key);
+// Iterate members with json_first and json_next, both return NULL at the end
+const json_value_t * json_first(const json_t * json, const json_value_t * value);
+const json_value_t * json_next(const json_t * json, const json_value_t * value);
+// fallback if value is NULL or not a number
+double json_number(const json_value_t * value, double fallback);
+int json_string_equals(const json_value_t * value, const char * string);
+// Unescapes the string into buffer, 0 terminated and cut to size. Returns the unescaped length.
+size_t json_string_copy(const json_value_t * value, char * buffer, size_t size);
+
+#endif
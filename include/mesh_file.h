@@ -0,0 +1,59 @@
+#ifndef MESH_FILE_H_
+#define MESH_FILE_H_
+
+#include <stdint.h>
+#include "allocator.h"
+#include "io.h"
+#include "shape.h"
+#include "vertex_layout.h"
+
+#define MESH_FILE_VERSION 1
+
+typedef struct mesh_file_submesh_t mesh_file_submesh_t;
+typedef struct mesh_file_t mesh_file_t;
+
+// A range of the index blob drawn on its own, with its own material
+struct mesh_file_submesh_t {
+    uint32_t first_index;
+    uint32_t index_count;
+    int32_t base_vertex;
+    uint32_t material;
+};
+
+// A mapped mesh file. vertices, indices and submeshes point into the
+// mapping, in the layout GL takes them, and stay valid until the file is
+// unloaded. On disk:
+//
+//   header         magic "BMSH", version, counts, blob offsets and sizes
+//   attributes     location and vertex_format_t per attribute, in layout order
+//   submeshes      mesh_file_submesh_t per submesh
+//   vertex blob    vertex_count vertices of the layout
+//   index blob     index_count indices of index_type
+//
+// Every blob starts on a 16 byte boundary. All values are little endian.
+struct mesh_file_t {
+    io_mapping_t mapping;
+    vertex_layout_t layout;
+    GLenum index_type; // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    const void * vertices;
+    size_t vertex_count;
+    size_t vertices_size;
+    const void * indices;
+    size_t index_count;
+    size_t indices_size;
+    const mesh_file_submesh_t * submeshes;
+    size_t submesh_count;
+};
+
+// Panics if the file is not a valid mesh file
+void mesh_file_load(mesh_file_t * mesh, const char * path, allocator_t * a);
+void mesh_file_unload(mesh_file_t * mesh);
+// Creates shape and uploads the blobs to it as they are mapped
+void mesh_file_create_shape(mesh_file_t * mesh, shape_t * shape);
+// A shape drawing submesh i, sharing the buffers of shape
+void mesh_file_submesh_shape(mesh_file_t * mesh, shape_t * shape, size_t i, shape_t * submesh);
+// Indices are stored in 16 bits when every one fits. A mesh without submeshes is given one
+// covering every index. Returns 0 if the file could not be written.
+int mesh_file_write(const char * path, const vertex_layout_t * layout, const void * vertices, size_t vertex_count, const unsigned int * indices, size_t index_count, const mesh_file_submesh_t * submeshes, size_t submesh_count);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef MESH_OPTIMIZER_H_
+#define MESH_OPTIMIZER_H_
+
+#include "allocator.h"
+#include <stddef.h>
+
+// Post transform cache size the orderings aim at, small enough to be beaten on current GPUs
+#define MESH_OPTIMIZER_CACHE_SIZE 16
+
+typedef struct mesh_cache_stats_t mesh_cache_stats_t;
+
+struct mesh_cache_stats_t {
+    unsigned int transformed; // vertex shader runs with a FIFO cache
+    float acmr; // per triangle, 3 is no reuse, 0.5 is the best a regular grid can do
+    float atvr; // per vertex referenced, 1 is optimal
+};
+
+// All orderings write to destination, which may be indices itself. a is used for scratch.
+
+// Tipsify: triangles are emitted around a fanning vertex picked to keep hits in a FIFO of cache_size vertices
+void mesh_optimize_vertex_cache(unsigned int * destination, const unsigned int * indices, size_t index_count, size_t vertex_count, unsigned int cache_size, allocator_t * a);
+// Run on the output of mesh_optimize_vertex_cache. Splits it in clusters where the cache restarts,
+// or where the cache hit rate allows it, up to threshold times the ACMR of the cluster, and draws
+// the clusters facing out from the centre first so that they occlude the others. positions are 3
+// floats at the start of every position_stride bytes.
+void mesh_optimize_overdraw(unsigned int * destination, const unsigned int * indices, size_t index_count, const float * positions, size_t position_stride, size_t vertex_count, unsigned int cache_size, float threshold, allocator_t * a);
+// Stores vertices in the order the indices first use them, remapping the indices in place.
+// Unreferenced vertices are dropped, returns how many are left. destination must not overlap vertices.
+size_t mesh_optimize_vertex_fetch(void * destination, unsigned int * indices, size_t index_count, const void * vertices, size_t vertex_count, size_t vertex_size, allocator_t * a);
+mesh_cache_stats_t mesh_analyze_vertex_cache(const unsigned int * indices, size_t index_count, size_t vertex_count, unsigned int cache_size, allocator_t * a);
+
+#endif
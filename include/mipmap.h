@@ -0,0 +1,30 @@
+#ifndef MIPMAP_H_
+#define MIPMAP_H_
+
+#include "allocator.h"
+#include "texture.h"
+
+#define MIPMAP_MAX_LEVELS 16
+
+typedef struct mipmap_chain_t mipmap_chain_t;
+
+typedef enum mipmap_filter_t {
+    MIPMAP_FILTER_BOX, // 2x2 average
+    MIPMAP_FILTER_KAISER, // 12 tap Kaiser windowed sinc, sharper but slower
+} mipmap_filter_t;
+
+// levels[0] is the source image and is not owned by the chain. Every other
+// level halves the size of the one before, rounding down, down to 1x1.
+struct mipmap_chain_t {
+    allocator_t * a;
+    int level_count;
+    texture_image_t levels[MIPMAP_MAX_LEVELS];
+};
+
+// The output only depends on the input, not on the instruction set used, so chains can be cached.
+// With srgb set the colour channels are averaged in linear space, alpha always is linear.
+void mipmap_generate(mipmap_chain_t * chain, texture_image_t * image, mipmap_filter_t filter, int srgb, allocator_t * a);
+void mipmap_free(mipmap_chain_t * chain);
+int mipmap_level_count(int width, int height);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef OBJ_H_
+#define OBJ_H_
+
+#include "allocator.h"
+#include "shape.h"
+#include "vertex_layout.h"
+
+// Attribute locations of the imported vertices
+#define OBJ_LOCATION_POSITION 0
+#define OBJ_LOCATION_TEXTURE_COORDINATE 1
+#define OBJ_LOCATION_NORMAL 2
+
+typedef struct obj_mesh_t obj_mesh_t;
+
+// Interleaved vertices, a float3 position followed by a float2 texture
+// coordinate and a float3 normal when the file has any of them. Every
+// distinct position, texture coordinate and normal tuple of the faces is one
+// vertex. Polygons are split into triangle fans.
+struct obj_mesh_t {
+    allocator_t * a;
+    vertex_layout_t layout;
+    float * vertices;
+    size_t vertex_count;
+    unsigned int * indices;
+    size_t index_count;
+};
+
+// The file is split at line boundaries over thread_count threads, 0 uses one per core.
+// a is used from all of them, so it has to be thread safe. Panics on malformed files.
+void obj_load(obj_mesh_t * mesh, const char * path, unsigned int thread_count, allocator_t * a);
+void obj_free(obj_mesh_t * mesh);
+void obj_create_shape(obj_mesh_t * mesh, shape_t * shape);
+// Stores the mesh in the binary mesh format, see mesh_file.h. Returns 0 if it could not be written.
+int obj_write_mesh_file(obj_mesh_t * mesh, const char * path);
+
+#endif
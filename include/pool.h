@@ -0,0 +1,54 @@
+#ifndef POOL_H_
+#define POOL_H_
+
+#include <stdint.h>
+#include "allocator.h"
+
+typedef struct pool_handle_t pool_handle_t;
+typedef struct pool_slot_t pool_slot_t;
+typedef struct pool_t pool_t;
+
+// generation 0 is never handed out, so a zeroed handle is always invalid
+struct pool_handle_t {
+    uint32_t index;
+    uint32_t generation;
+};
+
+struct pool_slot_t {
+    uint32_t generation;
+    uint32_t dense; // position in items if alive, next free slot otherwise
+};
+
+// Fixed size records kept packed at the front of items, so iterating over
+// items[0..count) touches only live records. Handles go through slots and
+// stay valid while records move, pointers do not survive pool_alloc/pool_free.
+struct pool_t {
+    allocator_t * a;
+    size_t item_size;
+    unsigned char * items;
+    uint32_t * item_slots; // slot of each item in items
+    pool_slot_t * slots;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t free_head;
+};
+
+void pool_init(pool_t * pool, size_t item_size, uint32_t capacity, allocator_t * a);
+void pool_deinit(pool_t * pool);
+// The new record is zeroed
+pool_handle_t pool_alloc(pool_t * pool);
+void pool_free(pool_t * pool, pool_handle_t handle);
+// NULL if the handle was freed or never valid
+void * pool_get(pool_t * pool, pool_handle_t handle);
+int pool_is_alive(pool_t * pool, pool_handle_t handle);
+pool_handle_t pool_handle_at(pool_t * pool, uint32_t i);
+
+static inline void * pool_items(pool_t * pool) {
+    return pool->items;
+}
+
+static inline uint32_t pool_count(pool_t * pool) {
+    return pool->count;
+}
+
+#endif
@@ -6,11 +6,19 @@
 
 typedef unsigned int shader_t;
 typedef unsigned int shader_program_t;
+typedef int shader_uniform_t;
 
 shader_t shader_compile(shader_t shader_type, const char * path, allocator_t * a);
+shader_t shader_compile_source(shader_t shader_type, const char * source);
 void shader_delete(shader_t shader);
-shader_program_t shader_program_link(shader_t vertex_shader, shader_t fragment_shader);
+// Also builds the name -> location table of the program, allocated with the allocator a and freed by shader_program_delete
+shader_program_t shader_program_link(shader_t vertex_shader, shader_t fragment_shader, allocator_t * a);
+void shader_program_delete(shader_program_t program);
 void shader_program_use(shader_program_t program);
+
+// Looks the location up in the table built at link time, the driver is only asked for unknown names
+shader_uniform_t shader_program_get_uniform(shader_program_t program, const char * name);
+
 void shader_program_set_int(shader_program_t program, const char * name, int value);
 void shader_program_set_2_int(shader_program_t program, const char * name, int value1, int value2);
 void shader_program_set_3_int(shader_program_t program, const char * name, int value1, int value2, int value3);
@@ -24,4 +32,17 @@ void shader_program_set_2_float(shader_program_t program, const char * name, flo
 void shader_program_set_3_float(shader_program_t program, const char * name, float value1, float value2, float value3);
 void shader_program_set_4_float(shader_program_t program, const char * name, float value1, float value2, float value3, float value4);
 
+void shader_program_set_uniform_int(shader_program_t program, shader_uniform_t uniform, int value);
+void shader_program_set_uniform_2_int(shader_program_t program, shader_uniform_t uniform, int value1, int value2);
+void shader_program_set_uniform_3_int(shader_program_t program, shader_uniform_t uniform, int value1, int value2, int value3);
+void shader_program_set_uniform_4_int(shader_program_t program, shader_uniform_t uniform, int value1, int value2, int value3, int value4);
+void shader_program_set_uniform_unsigned_int(shader_program_t program, shader_uniform_t uniform, unsigned int value);
+void shader_program_set_uniform_2_unsigned_int(shader_program_t program, shader_uniform_t uniform, unsigned int value1, unsigned int value2);
+void shader_program_set_uniform_3_unsigned_int(shader_program_t program, shader_uniform_t uniform, unsigned int value1, unsigned int value2, unsigned int value3);
+void shader_program_set_uniform_4_unsigned_int(shader_program_t program, shader_uniform_t uniform, unsigned int value1, unsigned int value2, unsigned int value3, unsigned int value4);
+void shader_program_set_uniform_float(shader_program_t program, shader_uniform_t uniform, float value);
+void shader_program_set_uniform_2_float(shader_program_t program, shader_uniform_t uniform, float value1, float value2);
+void shader_program_set_uniform_3_float(shader_program_t program, shader_uniform_t uniform, float value1, float value2, float value3);
+void shader_program_set_uniform_4_float(shader_program_t program, shader_uniform_t uniform, float value1, float value2, float value3, float value4);
+
 #endif
@@ -2,21 +2,51 @@
 #define SHAPE_H_
 
 #include "glad/glad.h"
+#include "stream_buffer.h"
+#include "vertex_layout.h"
 #include <stddef.h>
 
 typedef struct shape_t shape_t;
 
 struct shape_t {
     unsigned int element_count;
+    GLenum index_type; // GL_UNSIGNED_SHORT when every index fits, else GL_UNSIGNED_INT
+    int base_vertex; // added to every index, where the vertices start in VBO
+    unsigned int first_index; // where the indices start in EBO
     unsigned int VAO;
     unsigned int VBO;
     unsigned int EBO;
+    unsigned int instance_VBO; // 0 until instance data is set
 };
 
 void shape_init(shape_t * shape);
-void shape_load_vertices(shape_t * shape, float * vertices, size_t vertices_size);
+// The VBO is the buffer of the stream and belongs to it, vertices are written with shape_stream_vertices
+void shape_init_streamed(shape_t * shape, stream_buffer_t * stream);
+// Only the VAO is created, VBO and EBO are the caller's and are not deleted with the shape. EBO
+// may be 0, to be created and loaded later.
+void shape_init_from_buffers(shape_t * shape, unsigned int VBO, unsigned int EBO);
+void shape_load_vertices(shape_t * shape, const void * vertices, size_t vertices_size);
+// Writes this frame's vertices into the stream, without waiting on draws of earlier frames
+void shape_stream_vertices(shape_t * shape, stream_buffer_t * stream, void * vertices, size_t vertices_size, size_t stride);
 void shape_load_indices(shape_t * shape, unsigned int * indices, size_t indices_size);
+// Uploads indices already stored as index_type, as they are
+void shape_load_indices_typed(shape_t * shape, const void * indices, size_t indices_size, GLenum index_type);
+// For meshes of more vertices than 16 bit indices reach. Splits the triangles, in order, into
+// chunks that each reference fewer than 65536 vertices from their lowest, and stores them all
+// in 16 bits in the EBO of shape. Chunk i is drawn with chunks[i], which share the VAO, VBO and
+// EBO of shape. Vertices in first use order, see mesh_optimize_vertex_fetch, give the fewest
+// chunks. Returns how many chunks there are, panics if there are more than max_chunks.
+size_t shape_load_indices_split(shape_t * shape, shape_t * chunks, size_t max_chunks, unsigned int * indices, size_t indices_size);
+// Points every attribute of the layout at VBO, in place of one shape_interpret_and_enable per attribute
+void shape_set_layout(shape_t * shape, const vertex_layout_t * layout);
 void shape_interpret_and_enable(shape_t * shape ,unsigned int location, int vector_size, GLenum data_type, GLboolean normalised, size_t stride, void * offset_in_data);
+// For attributes read from a buffer other than VBO, like separate position and normal streams
+void shape_interpret_buffer_and_enable(shape_t * shape, unsigned int buffer, unsigned int location, int vector_size, GLenum data_type, GLboolean normalised, size_t stride, void * offset_in_data);
+// Per instance attributes come from their own buffer, replaced whole every call
+void shape_set_instance_data(shape_t * shape, void * data, size_t data_size);
+// Like shape_interpret_and_enable for the instance buffer, the attribute advances once every divisor instances
+void shape_interpret_instanced_and_enable(shape_t * shape, unsigned int location, int vector_size, GLenum data_type, GLboolean normalised, size_t stride, void * offset_in_data, unsigned int divisor);
 void shape_draw(shape_t * shape);
+void shape_draw_instanced(shape_t * shape, unsigned int instance_count);
 
 #endif
@@ -0,0 +1,48 @@
+#ifndef STREAM_BUFFER_H_
+#define STREAM_BUFFER_H_
+
+#include "glad/glad.h"
+#include <stddef.h>
+
+#define STREAM_BUFFER_REGIONS 3
+
+typedef struct stream_buffer_stats_t stream_buffer_stats_t;
+typedef struct stream_buffer_t stream_buffer_t;
+
+struct stream_buffer_stats_t {
+    size_t bytes;
+    unsigned int writes;
+    unsigned int orphans;
+    double stall_seconds; // time spent waiting for a region to come free
+};
+
+// A buffer for geometry rewritten every frame, split in regions used one
+// frame after the other. A region is fenced when its frame ends and only
+// written again, mapped unsynchronised, once the GPU is past the fence, so
+// writes never wait on draws still reading the buffer. A first write of a
+// frame larger than a region grows the regions by orphaning the buffer, the
+// driver then hands out fresh memory and the old one lives on until its draws
+// are done. Later writes of a frame cannot orphan without losing the earlier
+// ones, so a frame writing more than a region in total panics.
+struct stream_buffer_t {
+    unsigned int buffer;
+    size_t region_size;
+    unsigned int region;
+    size_t offset; // next free byte in the current region
+    GLsync fences[STREAM_BUFFER_REGIONS];
+    stream_buffer_stats_t frame;
+    stream_buffer_stats_t last_frame;
+};
+
+// region_size is what one frame is expected to write
+void stream_buffer_init(stream_buffer_t * stream, size_t region_size);
+void stream_buffer_deinit(stream_buffer_t * stream);
+// Returns the offset of the data in the buffer, a multiple of alignment so
+// that vertices can be drawn from it with a base vertex of offset / stride.
+// Panics if the data does not fit in what is left of the frame's region.
+size_t stream_buffer_write(stream_buffer_t * stream, const void * data, size_t size, size_t alignment);
+// Fences the region of this frame and moves on to the next one, call after the frame's draws
+void stream_buffer_end_frame(stream_buffer_t * stream);
+stream_buffer_stats_t stream_buffer_get_stats(stream_buffer_t * stream);
+
+#endif
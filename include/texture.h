@@ -2,9 +2,135 @@
 #define TEXTURE_H_
 
 #include "glad/glad.h"
+#include "allocator.h"
+#include "async_io.h"
 
 typedef unsigned int texture_t;
+typedef struct texture_image_t texture_image_t;
+typedef struct texture_job_t texture_job_t;
+typedef struct texture_loader_t texture_loader_t;
+typedef struct texture_pbo_t texture_pbo_t;
+typedef struct texture_upload_stats_t texture_upload_stats_t;
+typedef struct mipmap_chain_t mipmap_chain_t;
+typedef struct texture_cooked_t texture_cooked_t;
+typedef struct texture_array_t texture_array_t;
+
+#define TEXTURE_PBO_RING_SIZE 3
+
+// Decoded pixels, always 4 channels of 8 bits
+struct texture_image_t {
+    unsigned char * pixels;
+    int width;
+    int height;
+};
+
+// The loader's settings are copied in when the texture is requested, the
+// workers only read the copy while the GL thread may change the loader
+struct texture_job_t {
+    texture_loader_t * loader;
+    texture_t texture;
+    int generate_mipmaps;
+    int mipmap_filter; // a mipmap_filter_t
+    int srgb;
+    int compress_format; // a bc_format_t, -1 to upload uncompressed
+    const char * cache_dir;
+    texture_image_t image;
+    mipmap_chain_t * mipmaps; // NULL unless the loader generates mipmaps
+    texture_cooked_t * cooked; // NULL unless the loader compresses
+    texture_job_t * next;
+};
+
+struct texture_pbo_t {
+    unsigned int buffer;
+    size_t size;
+    GLsync fence; // signalled once the texture upload out of this buffer is done
+};
+
+struct texture_upload_stats_t {
+    size_t bytes;
+    unsigned int uploads;
+    double stall_seconds; // time spent in the driver on the pixel buffers and texture uploads
+    unsigned int orphans; // uploads that found their pixel buffer still being read and orphaned it
+};
+
+// Decodes on the async io workers and uploads on the GL thread. A texture
+// requested through the loader is usable straight away, it shows a 1x1
+// placeholder until its pixels are uploaded into the same texture object.
+struct texture_loader_t {
+    async_io_t * io;
+    allocator_t * a;
+    texture_job_t * uploads_head; // decoded, waiting for texture_loader_upload
+    texture_job_t * uploads_tail;
+    unsigned int in_flight;
+    int generate_mipmaps;
+    int mipmap_filter; // a mipmap_filter_t
+    int srgb;
+    int compress_format; // a bc_format_t, -1 to upload uncompressed
+    const char * cache_dir;
+    texture_pbo_t pbos[TEXTURE_PBO_RING_SIZE];
+    unsigned int next_pbo;
+    texture_upload_stats_t frame;
+    texture_upload_stats_t last_frame;
+};
+
+// Layers of one size in a GL_TEXTURE_2D_ARRAY, handed out as slots. Shaders
+// index the array with the slot instead of binding another texture, so draws
+// using different layers can go out in one draw call, see
+// shaders/array_fragment.glsl.
+struct texture_array_t {
+    texture_t texture;
+    allocator_t * a;
+    int width;
+    int height;
+    int layer_count;
+    int level_count;
+    int srgb;
+    int * next_free; // per free layer the free layer after it, -1 at the end, -2 for layers in use
+    int free_head;
+    int used;
+};
 
 void texture_init(texture_t * texture, const char * path);
+void texture_delete(texture_t texture);
+void texture_load_image(texture_image_t * image, const char * path);
+void texture_decode(texture_image_t * image, const char * name, const unsigned char * data, size_t size);
+void texture_image_free(texture_image_t * image);
+
+// Every level of every layer is allocated up front. With mipmaps set the layers get a box filtered mip chain.
+void texture_array_init(texture_array_t * array, int width, int height, int layer_count, int mipmaps, int srgb, allocator_t * a);
+void texture_array_deinit(texture_array_t * array);
+// Returns the layer the image went in, -1 if the array is full. The image has to be width x height.
+int texture_array_add(texture_array_t * array, texture_image_t * image);
+// Replaces the pixels of a layer in use
+void texture_array_set(texture_array_t * array, int layer, texture_image_t * image);
+// The layer keeps its pixels until it is handed out again
+void texture_array_remove(texture_array_t * array, int layer);
+void texture_array_bind(texture_array_t * array, unsigned int unit);
+
+// a holds the jobs and is used from the workers, so it has to be thread safe
+void texture_loader_init(texture_loader_t * loader, async_io_t * io, allocator_t * a);
+void texture_loader_deinit(texture_loader_t * loader);
+// Textures requested afterwards get a full mip chain built on the workers, see mipmap.h.
+// With srgb set they are stored as GL_SRGB8_ALPHA8 and filtered in linear space. Compression is
+// turned off if the context has no sRGB variant of its format.
+void texture_loader_set_mipmaps(texture_loader_t * loader, int generate_mipmaps, int mipmap_filter, int srgb);
+// Textures requested afterwards are block compressed on the workers, see texture_cache.h. Cooked
+// textures are kept in cache_dir, which has to outlive the loader. Returns 0, and leaves compression
+// off, if the context cannot sample the format in the loader's colour space.
+int texture_loader_set_compression(texture_loader_t * loader, int compress_format, const char * cache_dir);
+// format is a bc_format_t, srgb asks for its sRGB variant
+int texture_compression_supported(int format, int srgb);
+void texture_load_async(texture_loader_t * loader, texture_t * texture, const char * path, async_io_priority_t priority);
+// For encoded images already in memory, like ones embedded in a model. name only shows up in errors.
+void texture_load_async_memory(texture_loader_t * loader, texture_t * texture, const char * name, const void * data, size_t size, async_io_priority_t priority);
+// Uploads decoded textures until budget_seconds is spent, at least one if any is waiting. Returns how many were uploaded.
+unsigned int texture_loader_upload(texture_loader_t * loader, double budget_seconds);
+// Textures requested but not uploaded yet
+unsigned int texture_loader_pending(texture_loader_t * loader);
+// Replaces the pixels of a texture of the same size through the pixel buffer ring
+void texture_loader_stream(texture_loader_t * loader, texture_t texture, texture_image_t * image);
+// Closes the frame, its counters are kept for texture_loader_get_stats and the running ones are reset
+void texture_loader_end_frame(texture_loader_t * loader);
+texture_upload_stats_t texture_loader_get_stats(texture_loader_t * loader);
 
 #endif
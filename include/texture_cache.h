@@ -0,0 +1,42 @@
+#ifndef TEXTURE_CACHE_H_
+#define TEXTURE_CACHE_H_
+
+#include <stdint.h>
+#include "allocator.h"
+#include "bc.h"
+#include "mipmap.h"
+
+#define TEXTURE_CACHE_VERSION 1
+
+typedef struct texture_cooked_level_t texture_cooked_level_t;
+typedef struct texture_cooked_t texture_cooked_t;
+
+struct texture_cooked_level_t {
+    int width;
+    int height;
+    const unsigned char * data;
+    size_t size;
+};
+
+// A block compressed mip chain, the levels point into blob which holds the
+// cache file exactly as it is stored on disk
+struct texture_cooked_t {
+    GLenum internal_format;
+    int level_count;
+    texture_cooked_level_t levels[MIPMAP_MAX_LEVELS];
+    allocator_t * a;
+    unsigned char * blob;
+    size_t blob_size;
+    size_t blob_allocated; // read back blobs carry read_entire_file's terminator
+};
+
+// Hash of the source file and of everything that changes the cooked result
+uint64_t texture_cache_key(const unsigned char * source, size_t source_size, bc_format_t format, int mipmaps, mipmap_filter_t mipmap_filter, int srgb);
+
+// Loads the cooked texture from cache_dir if an entry for the key exists, otherwise decodes the
+// source, builds the mip chain with mipmap_filter if asked, encodes every level and stores the result in cache_dir.
+// Returns 1 on a cache hit.
+int texture_cache_cook(texture_cooked_t * cooked, const char * cache_dir, const char * name, const unsigned char * source, size_t source_size, bc_format_t format, int mipmaps, mipmap_filter_t mipmap_filter, int srgb, unsigned int thread_count, allocator_t * a);
+void texture_cooked_free(texture_cooked_t * cooked);
+
+#endif
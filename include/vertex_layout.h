@@ -0,0 +1,56 @@
+#ifndef VERTEX_LAYOUT_H_
+#define VERTEX_LAYOUT_H_
+
+#include "glad/glad.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define VERTEX_LAYOUT_MAX_ATTRIBUTES 16
+
+typedef struct vertex_attribute_t vertex_attribute_t;
+typedef struct vertex_layout_t vertex_layout_t;
+
+typedef enum vertex_format_t {
+    VERTEX_FORMAT_FLOAT,
+    VERTEX_FORMAT_FLOAT2,
+    VERTEX_FORMAT_FLOAT3,
+    VERTEX_FORMAT_FLOAT4,
+    VERTEX_FORMAT_HALF2, // see vertex_pack_half
+    VERTEX_FORMAT_HALF4,
+    VERTEX_FORMAT_UNORM8X4, // colours, see vertex_pack_colour
+    VERTEX_FORMAT_SNORM8X4,
+    VERTEX_FORMAT_UNORM16X2, // texture coordinates in [0, 1]
+    VERTEX_FORMAT_SNORM_2_10_10_10, // normals and tangents, see vertex_pack_normal
+    VERTEX_FORMAT_COUNT,
+} vertex_format_t;
+
+struct vertex_attribute_t {
+    unsigned int location;
+    vertex_format_t format;
+    size_t offset;
+};
+
+// Attributes are laid out in the order they are added, each on a 4 byte
+// boundary, which every format is a multiple of.
+struct vertex_layout_t {
+    vertex_attribute_t attributes[VERTEX_LAYOUT_MAX_ATTRIBUTES];
+    unsigned int attribute_count;
+    size_t stride;
+    uint64_t hash;
+};
+
+void vertex_layout_init(vertex_layout_t * layout);
+void vertex_layout_add(vertex_layout_t * layout, unsigned int location, vertex_format_t format);
+int vertex_layout_equal(const vertex_layout_t * layout, const vertex_layout_t * other);
+// Points and enables the attributes of the bound vertex array at the bound GL_ARRAY_BUFFER
+void vertex_layout_apply(const vertex_layout_t * layout);
+size_t vertex_format_size(vertex_format_t format);
+
+// Rounds to the nearest half float, out of range values become infinity
+uint16_t vertex_pack_half(float value);
+// Components in [-1, 1], w is 0
+uint32_t vertex_pack_normal(float x, float y, float z);
+// Components in [0, 1], as 4 bytes in memory order
+uint32_t vertex_pack_colour(float r, float g, float b, float a);
+
+#endif
@@ -0,0 +1,14 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+layout (location = 2) in vec2 aOffset; // per instance
+layout (location = 3) in float aLayer; // per instance
+
+out vec2 texCoord;
+flat out int layer;
+
+void main() {
+    gl_Position = vec4(aPos.xy + aOffset, aPos.z, 1.0);
+    texCoord = aTexCoord;
+    layer = int(aLayer);
+}
@@ -0,0 +1,11 @@
+#version 330 core
+out vec4 FragColor;
+in vec2 texCoord;
+in vec4 colour;
+flat in int layer;
+
+uniform sampler2DArray textures;
+
+void main() {
+    FragColor = texture(textures, vec3(texCoord, float(layer))) * colour;
+}
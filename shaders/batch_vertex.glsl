@@ -0,0 +1,16 @@
+#version 330 core
+layout (location = 0) in vec2 aPos;
+layout (location = 1) in vec2 aTexCoord;
+layout (location = 2) in vec4 aColour;
+layout (location = 3) in float aLayer;
+
+out vec2 texCoord;
+out vec4 colour;
+flat out int layer;
+
+void main() {
+    gl_Position = vec4(aPos, 0.0, 1.0);
+    texCoord = aTexCoord;
+    colour = aColour;
+    layer = int(aLayer);
+}
@@ -0,0 +1,180 @@
+#include "async_io.h"
+#include "io.h"
+#include "debug.h"
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+
+static async_io_request_t * pop_pending(async_io_t * io) {
+    for(int i = 0; i < ASYNC_IO_PRIORITY_COUNT; i++) {
+        async_io_request_t * request = io->pending_head[i];
+        if(!request) continue;
+        io->pending_head[i] = request->next;
+        if(!io->pending_head[i]) io->pending_tail[i] = NULL;
+        return request;
+    }
+    return NULL;
+}
+
+static void push_completed(async_io_t * io, async_io_request_t * request) {
+    async_io_request_t * head = atomic_load_explicit(&io->completed, memory_order_relaxed);
+    do {
+        request->next = head;
+    } while(!atomic_compare_exchange_weak_explicit(&io->completed, &head, request, memory_order_release, memory_order_relaxed));
+}
+
+static void * worker_main(void * argument) {
+    async_io_t * io = argument;
+
+    for(;;) {
+        pthread_mutex_lock(&io->mutex);
+        async_io_request_t * request;
+        while(!(request = pop_pending(io)) && !io->stopping) {
+            pthread_cond_wait(&io->wake, &io->mutex);
+        }
+        pthread_mutex_unlock(&io->mutex);
+        if(!request) break;
+
+        // Requests from async_io_submit already hold their data
+        if(!request->data) request->data = read_entire_file_sized(request->path, &request->size, io->a);
+        if(request->process) request->process(request);
+
+        push_completed(io, request);
+    }
+
+    return NULL;
+}
+
+void async_io_init(async_io_t * io, unsigned int worker_count, allocator_t * a) {
+    if(worker_count == 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        worker_count = cores > 0 ? (unsigned int)cores : 1;
+    }
+
+    io->a = a;
+    io->worker_count = worker_count;
+    io->stopping = 0;
+    for(int i = 0; i < ASYNC_IO_PRIORITY_COUNT; i++) {
+        io->pending_head[i] = NULL;
+        io->pending_tail[i] = NULL;
+    }
+    atomic_init(&io->completed, NULL);
+    atomic_init(&io->in_flight, 0);
+    pthread_mutex_init(&io->mutex, NULL);
+    pthread_cond_init(&io->wake, NULL);
+
+    io->workers = allocator_alloc(a, worker_count * sizeof(pthread_t));
+    if(!io->workers) panic("Failed to allocate %u async io workers\n", worker_count);
+    for(unsigned int i = 0; i < worker_count; i++) {
+        if(pthread_create(&io->workers[i], NULL, worker_main, io) != 0) panic("Failed to start async io worker %u\n", i);
+    }
+}
+
+void async_io_deinit(async_io_t * io) {
+    pthread_mutex_lock(&io->mutex);
+    io->stopping = 1;
+    pthread_cond_broadcast(&io->wake);
+    pthread_mutex_unlock(&io->mutex);
+
+    // Workers only stop once the pending queues are empty
+    for(unsigned int i = 0; i < io->worker_count; i++) {
+        pthread_join(io->workers[i], NULL);
+    }
+    async_io_poll(io);
+
+    allocator_free_sized(io->a, io->workers, io->worker_count * sizeof(pthread_t));
+    pthread_cond_destroy(&io->wake);
+    pthread_mutex_destroy(&io->mutex);
+}
+
+static async_io_request_t * new_request(async_io_t * io, const char * path, async_io_priority_t priority, async_io_process_t process, async_io_complete_t complete, void * user) {
+    // The path is copied in behind the request so the caller's string can go away
+    size_t path_size = strlen(path) + 1;
+    async_io_request_t * request = allocator_alloc(io->a, sizeof(async_io_request_t) + path_size);
+    if(!request) panic("Failed to allocate async io request for %s\n", path);
+
+    char * path_copy = (char *)(request + 1);
+    memcpy(path_copy, path, path_size);
+
+    request->io = io;
+    request->path = path_copy;
+    request->priority = priority;
+    request->process = process;
+    request->complete = complete;
+    request->user = user;
+    request->data = NULL;
+    request->size = 0;
+    request->result = NULL;
+    request->next = NULL;
+    return request;
+}
+
+static void queue_request(async_io_t * io, async_io_request_t * request) {
+    async_io_priority_t priority = request->priority;
+    atomic_fetch_add_explicit(&io->in_flight, 1, memory_order_relaxed);
+
+    pthread_mutex_lock(&io->mutex);
+    if(io->pending_tail[priority]) io->pending_tail[priority]->next = request;
+    else io->pending_head[priority] = request;
+    io->pending_tail[priority] = request;
+    pthread_cond_signal(&io->wake);
+    pthread_mutex_unlock(&io->mutex);
+}
+
+async_io_request_t * async_io_read(async_io_t * io, const char * path, async_io_priority_t priority, async_io_process_t process, async_io_complete_t complete, void * user) {
+    async_io_request_t * request = new_request(io, path, priority, process, complete, user);
+    queue_request(io, request);
+    return request;
+}
+
+async_io_request_t * async_io_submit(async_io_t * io, const char * name, const void * data, size_t size, async_io_priority_t priority, async_io_process_t process, async_io_complete_t complete, void * user) {
+    async_io_request_t * request = new_request(io, name, priority, process, complete, user);
+
+    // Copied with a 0 terminator like file reads, so process and poll free it the same way
+    request->data = allocator_alloc(io->a, size + 1);
+    if(!request->data) panic("Failed to allocate %zu bytes for async io request %s\n", size, name);
+    memcpy(request->data, data, size);
+    request->data[size] = 0;
+    request->size = size;
+
+    queue_request(io, request);
+    return request;
+}
+
+unsigned int async_io_poll(async_io_t * io) {
+    async_io_request_t * stack = atomic_exchange_explicit(&io->completed, NULL, memory_order_acquire);
+
+    // The stack hands requests back newest first, flip it to finish them in completion order
+    async_io_request_t * list = NULL;
+    while(stack) {
+        async_io_request_t * next = stack->next;
+        stack->next = list;
+        list = stack;
+        stack = next;
+    }
+
+    unsigned int count = 0;
+    while(list) {
+        async_io_request_t * request = list;
+        list = list->next;
+
+        if(request->complete) request->complete(request);
+        if(request->data) allocator_free_sized(io->a, request->data, request->size + 1);
+        allocator_free_sized(io->a, request, sizeof(async_io_request_t) + strlen(request->path) + 1);
+
+        atomic_fetch_sub_explicit(&io->in_flight, 1, memory_order_relaxed);
+        count++;
+    }
+
+    return count;
+}
+
+void async_io_flush(async_io_t * io) {
+    while(atomic_load_explicit(&io->in_flight, memory_order_relaxed) > 0) {
+        if(async_io_poll(io) == 0) sched_yield();
+    }
+}
+
+unsigned int async_io_in_flight(async_io_t * io) {
+    return atomic_load_explicit(&io->in_flight, memory_order_relaxed);
+}
@@ -0,0 +1,207 @@
+#include "atlas.h"
+#include "mipmap.h"
+#include "gl_state.h"
+#include "debug.h"
+#include <string.h>
+
+static void page_init(atlas_t * atlas, atlas_page_t * page) {
+    size_t size = (size_t)atlas->page_size * atlas->page_size * 4;
+    page->texture = 0;
+    page->pixels = allocator_clean_alloc(atlas->a, size, 1);
+    // The skyline never has more segments than texel columns, one more while
+    // skyline_insert has added a segment but not yet cut the ones it covers
+    page->skyline = allocator_alloc(atlas->a, (atlas->page_size + 1) * sizeof(atlas_node_t));
+    if(!page->pixels || !page->skyline) panic("Failed to allocate atlas page of %d texels\n", atlas->page_size);
+
+    page->skyline[0].x = 0;
+    page->skyline[0].y = 0;
+    page->skyline[0].width = atlas->page_size;
+    page->node_count = 1;
+    page->dirty = 1;
+}
+
+void atlas_init(atlas_t * atlas, int page_size, int padding, int srgb, allocator_t * a) {
+    atlas->a = a;
+    atlas->page_size = page_size;
+    atlas->padding = padding;
+    atlas->srgb = srgb;
+    atlas->page_count = 0;
+}
+
+void atlas_deinit(atlas_t * atlas) {
+    for(int i = 0; i < atlas->page_count; i++) {
+        atlas_page_t * page = &atlas->pages[i];
+        allocator_free_sized(atlas->a, page->pixels, (size_t)atlas->page_size * atlas->page_size * 4);
+        allocator_free_sized(atlas->a, page->skyline, (atlas->page_size + 1) * sizeof(atlas_node_t));
+        if(page->texture) texture_delete(page->texture);
+    }
+    atlas->page_count = 0;
+}
+
+// Height the rectangle would sit at if its left edge went on node i, -1 if it does not fit there
+static int skyline_fit(atlas_t * atlas, atlas_page_t * page, int i, int width, int height) {
+    int x = page->skyline[i].x;
+    if(x + width > atlas->page_size) return -1;
+
+    int y = 0;
+    int remaining = width;
+    while(remaining > 0) {
+        if(page->skyline[i].y > y) y = page->skyline[i].y;
+        if(y + height > atlas->page_size) return -1;
+        remaining -= page->skyline[i].width;
+        i++;
+    }
+    return y;
+}
+
+static void skyline_insert(atlas_page_t * page, int i, int x, int y, int width) {
+    memmove(&page->skyline[i + 1], &page->skyline[i], (page->node_count - i) * sizeof(atlas_node_t));
+    page->skyline[i].x = x;
+    page->skyline[i].y = y;
+    page->skyline[i].width = width;
+    page->node_count++;
+
+    // Cut the segments the new one now covers
+    for(int j = i + 1; j < page->node_count; j++) {
+        atlas_node_t * node = &page->skyline[j];
+        int covered = x + width - node->x;
+        if(covered <= 0) break;
+        if(covered < node->width) {
+            node->x += covered;
+            node->width -= covered;
+            break;
+        }
+        memmove(node, node + 1, (page->node_count - j - 1) * sizeof(atlas_node_t));
+        page->node_count--;
+        j--;
+    }
+
+    // Merge neighbours at the same height
+    for(int j = 0; j + 1 < page->node_count; j++) {
+        if(page->skyline[j].y == page->skyline[j + 1].y) {
+            page->skyline[j].width += page->skyline[j + 1].width;
+            memmove(&page->skyline[j + 1], &page->skyline[j + 2], (page->node_count - j - 2) * sizeof(atlas_node_t));
+            page->node_count--;
+            j--;
+        }
+    }
+}
+
+// Bottom left: the lowest spot, ties go to the narrowest segment
+static int page_pack(atlas_t * atlas, atlas_page_t * page, int width, int height, int * out_x, int * out_y) {
+    int best = -1, best_y = atlas->page_size, best_width = atlas->page_size + 1;
+    for(int i = 0; i < page->node_count; i++) {
+        int y = skyline_fit(atlas, page, i, width, height);
+        if(y < 0) continue;
+        if(y < best_y || (y == best_y && page->skyline[i].width < best_width)) {
+            best = i;
+            best_y = y;
+            best_width = page->skyline[i].width;
+        }
+    }
+    if(best < 0) return 0;
+
+    *out_x = page->skyline[best].x;
+    *out_y = best_y;
+    skyline_insert(page, best, *out_x, best_y + height, width);
+    return 1;
+}
+
+// Copies the image with its edge texels repeated into the padding around it
+static void blit_padded(atlas_t * atlas, atlas_page_t * page, const texture_image_t * image, int x, int y) {
+    int padding = atlas->padding;
+    for(int row = -padding; row < image->height + padding; row++) {
+        int sy = row < 0 ? 0 : (row >= image->height ? image->height - 1 : row);
+        unsigned char * dst = page->pixels + ((size_t)(y + padding + row) * atlas->page_size + x) * 4;
+        const unsigned char * src = image->pixels + (size_t)sy * image->width * 4;
+
+        for(int i = 0; i < padding; i++) memcpy(dst + i * 4, src, 4);
+        memcpy(dst + padding * 4, src, (size_t)image->width * 4);
+        for(int i = 0; i < padding; i++) memcpy(dst + (padding + image->width + i) * 4, src + (image->width - 1) * 4, 4);
+    }
+    page->dirty = 1;
+}
+
+int atlas_add_image(atlas_t * atlas, const texture_image_t * image, atlas_region_t * region) {
+    int width = image->width + 2 * atlas->padding;
+    int height = image->height + 2 * atlas->padding;
+    if(width > atlas->page_size || height > atlas->page_size) return 0;
+
+    int page_index = -1, x = 0, y = 0;
+    for(int i = 0; i < atlas->page_count && page_index < 0; i++) {
+        if(page_pack(atlas, &atlas->pages[i], width, height, &x, &y)) page_index = i;
+    }
+    if(page_index < 0) {
+        if(atlas->page_count == ATLAS_MAX_PAGES) return 0;
+        page_index = atlas->page_count++;
+        page_init(atlas, &atlas->pages[page_index]);
+        page_pack(atlas, &atlas->pages[page_index], width, height, &x, &y);
+    }
+
+    blit_padded(atlas, &atlas->pages[page_index], image, x, y);
+
+    float scale = 1.0f / atlas->page_size;
+    region->page = page_index;
+    region->x = x + atlas->padding;
+    region->y = y + atlas->padding;
+    region->width = image->width;
+    region->height = image->height;
+    region->u0 = region->x * scale;
+    region->v0 = region->y * scale;
+    region->u1 = (region->x + image->width) * scale;
+    region->v1 = (region->y + image->height) * scale;
+    return 1;
+}
+
+int atlas_add_file(atlas_t * atlas, const char * path, atlas_region_t * region) {
+    texture_image_t image;
+    texture_load_image(&image, path);
+    int added = atlas_add_image(atlas, &image, region);
+    texture_image_free(&image);
+    return added;
+}
+
+// Levels past floor(log2(padding)) average texels of neighbouring images together
+static int clean_level_count(atlas_t * atlas) {
+    int levels = 1;
+    while((2 << (levels - 1)) <= atlas->padding) levels++;
+    return levels;
+}
+
+void atlas_upload(atlas_t * atlas, int mipmaps) {
+    int max_levels = mipmaps ? clean_level_count(atlas) : 1;
+    GLenum internal_format = atlas->srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+    for(int i = 0; i < atlas->page_count; i++) {
+        atlas_page_t * page = &atlas->pages[i];
+        if(!page->dirty) continue;
+
+        if(!page->texture) {
+            glGenTextures(1, &page->texture);
+            gl_state_bind_texture(GL_TEXTURE_2D, page->texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        }
+        gl_state_bind_texture(GL_TEXTURE_2D, page->texture);
+
+        texture_image_t image = { page->pixels, atlas->page_size, atlas->page_size };
+        mipmap_chain_t chain;
+        if(max_levels > 1) {
+            mipmap_generate(&chain, &image, MIPMAP_FILTER_BOX, atlas->srgb, atlas->a);
+        } else {
+            chain.level_count = 1;
+            chain.levels[0] = image;
+        }
+
+        int level_count = chain.level_count < max_levels ? chain.level_count : max_levels;
+        for(int level = 0; level < level_count; level++) {
+            texture_image_t * l = &chain.levels[level];
+            glTexImage2D(GL_TEXTURE_2D, level, internal_format, l->width, l->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, l->pixels);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level_count - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, level_count > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+
+        if(max_levels > 1) mipmap_free(&chain);
+        page->dirty = 0;
+    }
+}
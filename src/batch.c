@@ -0,0 +1,178 @@
+#include "batch.h"
+#include "gl_state.h"
+#include "debug.h"
+#include <string.h>
+
+void batch_init(batch_t * batch, unsigned int capacity, allocator_t * a) {
+    batch->a = a;
+    batch->capacity = capacity > 0 ? capacity : 1;
+    batch->quad_count = 0;
+    batch->quads = allocator_alloc(a, batch->capacity * sizeof(batch_quad_t));
+    batch->vertices = allocator_alloc(a, batch->capacity * 4 * sizeof(batch_vertex_t));
+    if(!batch->quads || !batch->vertices) panic("Failed to allocate batch of %u quads\n", batch->capacity);
+    batch->buffer_size = 0;
+    batch->state_count = 0;
+    batch->current_state = 0;
+    memset(&batch->frame, 0, sizeof(batch->frame));
+    memset(&batch->last_frame, 0, sizeof(batch->last_frame));
+
+    // Every draw starts at vertex 0 through the base vertex, so one set of indices serves them all
+    uint16_t * indices = allocator_alloc(a, BATCH_QUADS_PER_DRAW * 6 * sizeof(uint16_t));
+    if(!indices) panic("Failed to allocate batch indices\n");
+    for(unsigned int i = 0; i < BATCH_QUADS_PER_DRAW; i++) {
+        uint16_t v = (uint16_t)(i * 4);
+        uint16_t * quad = indices + i * 6;
+        quad[0] = v;
+        quad[1] = v + 1;
+        quad[2] = v + 2;
+        quad[3] = v + 2;
+        quad[4] = v + 3;
+        quad[5] = v;
+    }
+
+    shape_init(&batch->shape);
+    gl_state_bind_vertex_array(batch->shape.VAO);
+    gl_state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, batch->shape.EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, BATCH_QUADS_PER_DRAW * 6 * sizeof(uint16_t), indices, GL_STATIC_DRAW);
+    allocator_free_sized(a, indices, BATCH_QUADS_PER_DRAW * 6 * sizeof(uint16_t));
+
+    shape_interpret_and_enable(&batch->shape, 0, 2, GL_FLOAT, GL_FALSE, sizeof(batch_vertex_t), (void *)offsetof(batch_vertex_t, x));
+    shape_interpret_and_enable(&batch->shape, 1, 2, GL_FLOAT, GL_FALSE, sizeof(batch_vertex_t), (void *)offsetof(batch_vertex_t, u));
+    shape_interpret_and_enable(&batch->shape, 2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(batch_vertex_t), (void *)offsetof(batch_vertex_t, colour));
+    shape_interpret_and_enable(&batch->shape, 3, 1, GL_FLOAT, GL_FALSE, sizeof(batch_vertex_t), (void *)offsetof(batch_vertex_t, layer));
+}
+
+void batch_deinit(batch_t * batch) {
+    allocator_free_sized(batch->a, batch->quads, batch->capacity * sizeof(batch_quad_t));
+    allocator_free_sized(batch->a, batch->vertices, batch->capacity * 4 * sizeof(batch_vertex_t));
+
+    gl_state_forget_vertex_array(batch->shape.VAO);
+    gl_state_forget_buffer(batch->shape.VBO);
+    gl_state_forget_buffer(batch->shape.EBO);
+    glDeleteVertexArrays(1, &batch->shape.VAO);
+    glDeleteBuffers(1, &batch->shape.VBO);
+    glDeleteBuffers(1, &batch->shape.EBO);
+}
+
+void batch_set_state(batch_t * batch, shader_program_t program, GLenum target, texture_t texture) {
+    for(unsigned int i = 0; i < batch->state_count; i++) {
+        batch_state_t * state = &batch->states[i];
+        if(state->program == program && state->target == target && state->texture == texture) {
+            batch->current_state = i;
+            return;
+        }
+    }
+
+    if(batch->state_count == BATCH_MAX_STATES) batch_flush(batch);
+    batch->current_state = batch->state_count++;
+    batch->states[batch->current_state].program = program;
+    batch->states[batch->current_state].target = target;
+    batch->states[batch->current_state].texture = texture;
+}
+
+static void grow(batch_t * batch) {
+    unsigned int capacity = batch->capacity * 2;
+    batch->quads = allocator_realloc(batch->a, batch->quads, capacity * sizeof(batch_quad_t));
+    batch->vertices = allocator_realloc(batch->a, batch->vertices, capacity * 4 * sizeof(batch_vertex_t));
+    if(!batch->quads || !batch->vertices) panic("Failed to grow batch to %u quads\n", capacity);
+    batch->capacity = capacity;
+}
+
+void batch_quad_vertices(batch_t * batch, const batch_vertex_t vertices[4]) {
+    if(batch->state_count == 0) panic("Adding a quad to a batch without a state\n");
+    if(batch->quad_count == batch->capacity) grow(batch);
+
+    batch_quad_t * quad = &batch->quads[batch->quad_count++];
+    memcpy(quad->vertices, vertices, sizeof(quad->vertices));
+    quad->state = batch->current_state;
+}
+
+void batch_quad(batch_t * batch, float x, float y, float width, float height, const float uv[4], const uint8_t colour[4], float layer) {
+    batch_vertex_t vertices[4] = {
+        { x, y, uv[0], uv[1], { colour[0], colour[1], colour[2], colour[3] }, layer },
+        { x + width, y, uv[2], uv[1], { colour[0], colour[1], colour[2], colour[3] }, layer },
+        { x + width, y + height, uv[2], uv[3], { colour[0], colour[1], colour[2], colour[3] }, layer },
+        { x, y + height, uv[0], uv[3], { colour[0], colour[1], colour[2], colour[3] }, layer },
+    };
+    batch_quad_vertices(batch, vertices);
+}
+
+static int state_less(const batch_state_t * a, const batch_state_t * b) {
+    if(a->program != b->program) return a->program < b->program;
+    if(a->target != b->target) return a->target < b->target;
+    return a->texture < b->texture;
+}
+
+// The current state stays as the only one, so quads added after a flush need no batch_set_state
+static void keep_current_state(batch_t * batch) {
+    if(batch->state_count == 0) return;
+    batch->states[0] = batch->states[batch->current_state];
+    batch->state_count = 1;
+    batch->current_state = 0;
+}
+
+void batch_flush(batch_t * batch) {
+    if(batch->quad_count == 0) {
+        keep_current_state(batch);
+        return;
+    }
+
+    // States drawn ordered by program, then texture, so each program is bound once per flush
+    unsigned int order[BATCH_MAX_STATES];
+    unsigned int rank[BATCH_MAX_STATES];
+    for(unsigned int i = 0; i < batch->state_count; i++) {
+        unsigned int j = i;
+        for(; j > 0 && state_less(&batch->states[i], &batch->states[order[j - 1]]); j--) order[j] = order[j - 1];
+        order[j] = i;
+    }
+    for(unsigned int i = 0; i < batch->state_count; i++) rank[order[i]] = i;
+
+    // Counting sort on the rank of the state, stable so quads keep their order within a state
+    unsigned int first[BATCH_MAX_STATES + 1] = { 0 };
+    for(unsigned int i = 0; i < batch->quad_count; i++) first[rank[batch->quads[i].state] + 1]++;
+    for(unsigned int i = 0; i < batch->state_count; i++) first[i + 1] += first[i];
+
+    unsigned int next[BATCH_MAX_STATES];
+    memcpy(next, first, sizeof(next));
+    for(unsigned int i = 0; i < batch->quad_count; i++) {
+        batch_quad_t * quad = &batch->quads[i];
+        memcpy(&batch->vertices[next[rank[quad->state]]++ * 4], quad->vertices, sizeof(quad->vertices));
+    }
+
+    // Orphan the buffer so the upload does not wait for the draws of the last flush
+    size_t size = (size_t)batch->quad_count * 4 * sizeof(batch_vertex_t);
+    gl_state_bind_vertex_array(batch->shape.VAO);
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, batch->shape.VBO);
+    if(size > batch->buffer_size) batch->buffer_size = size;
+    glBufferData(GL_ARRAY_BUFFER, batch->buffer_size, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, batch->vertices);
+
+    for(unsigned int s = 0; s < batch->state_count; s++) {
+        if(first[s] == first[s + 1]) continue;
+
+        batch_state_t * state = &batch->states[order[s]];
+        shader_program_use(state->program);
+        gl_state_bind_texture_unit(0, state->target, state->texture);
+
+        for(unsigned int quad = first[s]; quad < first[s + 1]; quad += BATCH_QUADS_PER_DRAW) {
+            unsigned int count = first[s + 1] - quad;
+            if(count > BATCH_QUADS_PER_DRAW) count = BATCH_QUADS_PER_DRAW;
+            glDrawElementsBaseVertex(GL_TRIANGLES, count * 6, GL_UNSIGNED_SHORT, 0, quad * 4);
+            batch->frame.draws++;
+        }
+    }
+
+    batch->frame.quads += batch->quad_count;
+    batch->frame.flushes++;
+    batch->quad_count = 0;
+    keep_current_state(batch);
+}
+
+void batch_end_frame(batch_t * batch) {
+    batch->last_frame = batch->frame;
+    memset(&batch->frame, 0, sizeof(batch->frame));
+}
+
+batch_stats_t batch_get_stats(batch_t * batch) {
+    return batch->last_frame;
+}
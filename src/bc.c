@@ -0,0 +1,337 @@
+#include "bc.h"
+#include "debug.h"
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+typedef struct bc_work_t bc_work_t;
+
+struct bc_work_t {
+    bc_format_t format;
+    const texture_image_t * image;
+    unsigned char * out;
+    int first_row; // rows of blocks
+    int last_row;
+};
+
+static const int bc7_weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+static inline int clamp_int(int v, int lo, int hi) {
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+size_t bc_block_size(bc_format_t format) {
+    return format == BC_FORMAT_BC1 || format == BC_FORMAT_BC4 ? 8 : 16;
+}
+
+size_t bc_image_size(bc_format_t format, int width, int height) {
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * bc_block_size(format);
+}
+
+GLenum bc_gl_format(bc_format_t format, int srgb) {
+    switch(format) {
+        case BC_FORMAT_BC1: return srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case BC_FORMAT_BC3: return srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case BC_FORMAT_BC4: return GL_COMPRESSED_RED_RGTC1;
+        case BC_FORMAT_BC5: return GL_COMPRESSED_RG_RGTC2;
+        case BC_FORMAT_BC7: return srgb ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+        default: panic("Unknown block compression format %d\n", format);
+    }
+    return 0;
+}
+
+// Principal axis of the block through power iteration on the covariance, channels at a time
+static void principal_axis(const unsigned char * rgba, int channels, float * mean, float * axis) {
+    float cov[4][4] = { { 0 } };
+    for(int c = 0; c < channels; c++) {
+        mean[c] = 0.0f;
+        for(int i = 0; i < 16; i++) mean[c] += rgba[i * 4 + c];
+        mean[c] /= 16.0f;
+    }
+    for(int i = 0; i < 16; i++) {
+        for(int a = 0; a < channels; a++) {
+            for(int b = 0; b < channels; b++) {
+                cov[a][b] += (rgba[i * 4 + a] - mean[a]) * (rgba[i * 4 + b] - mean[b]);
+            }
+        }
+    }
+
+    for(int c = 0; c < channels; c++) axis[c] = 1.0f;
+    for(int iteration = 0; iteration < 8; iteration++) {
+        float next[4] = { 0 };
+        float largest = 0.0f;
+        for(int a = 0; a < channels; a++) {
+            for(int b = 0; b < channels; b++) next[a] += cov[a][b] * axis[b];
+            float magnitude = next[a] < 0.0f ? -next[a] : next[a];
+            if(magnitude > largest) largest = magnitude;
+        }
+        if(largest == 0.0f) break;
+        for(int c = 0; c < channels; c++) axis[c] = next[c] / largest;
+    }
+}
+
+// Extremes of the block along its principal axis
+static void axis_endpoints(const unsigned char * rgba, int channels, float * e0, float * e1) {
+    float mean[4], axis[4];
+    principal_axis(rgba, channels, mean, axis);
+
+    float lo = 0.0f, hi = 0.0f;
+    for(int i = 0; i < 16; i++) {
+        float t = 0.0f;
+        for(int c = 0; c < channels; c++) t += (rgba[i * 4 + c] - mean[c]) * axis[c];
+        if(t < lo) lo = t;
+        if(t > hi) hi = t;
+    }
+
+    float length = 0.0f;
+    for(int c = 0; c < channels; c++) length += axis[c] * axis[c];
+    if(length > 0.0f) {
+        lo /= length;
+        hi /= length;
+    }
+    for(int c = 0; c < channels; c++) {
+        e0[c] = mean[c] + axis[c] * hi;
+        e1[c] = mean[c] + axis[c] * lo;
+    }
+}
+
+static inline uint16_t pack_565(const float * c) {
+    int r = clamp_int((int)(c[0] * 31.0f / 255.0f + 0.5f), 0, 31);
+    int g = clamp_int((int)(c[1] * 63.0f / 255.0f + 0.5f), 0, 63);
+    int b = clamp_int((int)(c[2] * 31.0f / 255.0f + 0.5f), 0, 31);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static inline void unpack_565(uint16_t c, int * rgb) {
+    rgb[0] = ((c >> 11) & 31) * 255 / 31;
+    rgb[1] = ((c >> 5) & 63) * 255 / 63;
+    rgb[2] = (c & 31) * 255 / 31;
+}
+
+void bc_encode_block_bc1(const unsigned char * rgba, unsigned char * out) {
+    float e0[4], e1[4];
+    axis_endpoints(rgba, 3, e0, e1);
+    uint16_t c0 = pack_565(e0);
+    uint16_t c1 = pack_565(e1);
+
+    // c0 > c1 selects the opaque four colour mode
+    if(c0 < c1) {
+        uint16_t t = c0;
+        c0 = c1;
+        c1 = t;
+    }
+
+    uint32_t indices = 0;
+    if(c0 != c1) {
+        int palette[4][3];
+        unpack_565(c0, palette[0]);
+        unpack_565(c1, palette[1]);
+        for(int c = 0; c < 3; c++) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for(int i = 0; i < 16; i++) {
+            int best = 0, best_error = 1 << 30;
+            for(int p = 0; p < 4; p++) {
+                int error = 0;
+                for(int c = 0; c < 3; c++) {
+                    int d = rgba[i * 4 + c] - palette[p][c];
+                    error += d * d;
+                }
+                if(error < best_error) {
+                    best_error = error;
+                    best = p;
+                }
+            }
+            indices |= (uint32_t)best << (2 * i);
+        }
+    }
+
+    out[0] = c0 & 0xFF;
+    out[1] = c0 >> 8;
+    out[2] = c1 & 0xFF;
+    out[3] = c1 >> 8;
+    for(int i = 0; i < 4; i++) out[4 + i] = (indices >> (8 * i)) & 0xFF;
+}
+
+void bc_encode_block_bc4(const unsigned char * rgba, int channel, unsigned char * out) {
+    int lo = 255, hi = 0;
+    for(int i = 0; i < 16; i++) {
+        int v = rgba[i * 4 + channel];
+        if(v < lo) lo = v;
+        if(v > hi) hi = v;
+    }
+
+    // hi > lo selects the eight value mode: hi, lo and six steps in between
+    uint64_t indices = 0;
+    if(hi > lo) {
+        int palette[8];
+        palette[0] = hi;
+        palette[1] = lo;
+        for(int p = 1; p < 7; p++) palette[p + 1] = ((7 - p) * hi + p * lo) / 7;
+        for(int i = 0; i < 16; i++) {
+            int v = rgba[i * 4 + channel];
+            int best = 0, best_error = 256;
+            for(int p = 0; p < 8; p++) {
+                int error = v > palette[p] ? v - palette[p] : palette[p] - v;
+                if(error < best_error) {
+                    best_error = error;
+                    best = p;
+                }
+            }
+            indices |= (uint64_t)best << (3 * i);
+        }
+    }
+
+    out[0] = (unsigned char)hi;
+    out[1] = (unsigned char)lo;
+    for(int i = 0; i < 6; i++) out[2 + i] = (indices >> (8 * i)) & 0xFF;
+}
+
+void bc_encode_block_bc3(const unsigned char * rgba, unsigned char * out) {
+    bc_encode_block_bc4(rgba, 3, out);
+    bc_encode_block_bc1(rgba, out + 8);
+}
+
+void bc_encode_block_bc5(const unsigned char * rgba, unsigned char * out) {
+    bc_encode_block_bc4(rgba, 0, out);
+    bc_encode_block_bc4(rgba, 1, out + 8);
+}
+
+static inline void put_bits(unsigned char * out, int * position, uint32_t value, int count) {
+    for(int i = 0; i < count; i++, (*position)++) {
+        if(value & (1u << i)) out[*position >> 3] |= (unsigned char)(1u << (*position & 7));
+    }
+}
+
+// Mode 6: one subset, 7 bit RGBA endpoints with a shared low bit each, 4 bit indices
+void bc_encode_block_bc7(const unsigned char * rgba, unsigned char * out) {
+    float e[2][4];
+    axis_endpoints(rgba, 4, e[0], e[1]);
+
+    int q[2][4], p[2];
+    int endpoints[2][4];
+    for(int j = 0; j < 2; j++) {
+        int best_error = 1 << 30;
+        for(int bit = 0; bit < 2; bit++) {
+            int error = 0, candidate[4];
+            for(int c = 0; c < 4; c++) {
+                candidate[c] = clamp_int((int)((e[j][c] - bit) / 2.0f + 0.5f), 0, 127);
+                int d = ((candidate[c] << 1) | bit) - (int)(e[j][c] + 0.5f);
+                error += d * d;
+            }
+            if(error < best_error) {
+                best_error = error;
+                p[j] = bit;
+                memcpy(q[j], candidate, sizeof(candidate));
+            }
+        }
+        for(int c = 0; c < 4; c++) endpoints[j][c] = (q[j][c] << 1) | p[j];
+    }
+
+    int indices[16];
+    for(int i = 0; i < 16; i++) {
+        int best = 0, best_error = 1 << 30;
+        for(int w = 0; w < 16; w++) {
+            int error = 0;
+            for(int c = 0; c < 4; c++) {
+                int v = ((64 - bc7_weights[w]) * endpoints[0][c] + bc7_weights[w] * endpoints[1][c] + 32) >> 6;
+                int d = rgba[i * 4 + c] - v;
+                error += d * d;
+            }
+            if(error < best_error) {
+                best_error = error;
+                best = w;
+            }
+        }
+        indices[i] = best;
+    }
+
+    // The top bit of the first index is implied 0, swap the endpoints if it is not
+    if(indices[0] & 8) {
+        for(int c = 0; c < 4; c++) {
+            int t = q[0][c];
+            q[0][c] = q[1][c];
+            q[1][c] = t;
+        }
+        int t = p[0];
+        p[0] = p[1];
+        p[1] = t;
+        for(int i = 0; i < 16; i++) indices[i] = 15 - indices[i];
+    }
+
+    memset(out, 0, 16);
+    int position = 0;
+    put_bits(out, &position, 1u << 6, 7);
+    for(int c = 0; c < 4; c++) {
+        put_bits(out, &position, q[0][c], 7);
+        put_bits(out, &position, q[1][c], 7);
+    }
+    put_bits(out, &position, p[0], 1);
+    put_bits(out, &position, p[1], 1);
+    put_bits(out, &position, indices[0], 3);
+    for(int i = 1; i < 16; i++) put_bits(out, &position, indices[i], 4);
+}
+
+static void encode_rows(bc_work_t * work) {
+    const texture_image_t * image = work->image;
+    int blocks_x = (image->width + 3) / 4;
+    size_t block_size = bc_block_size(work->format);
+    unsigned char block[64];
+
+    for(int by = work->first_row; by < work->last_row; by++) {
+        for(int bx = 0; bx < blocks_x; bx++) {
+            for(int y = 0; y < 4; y++) {
+                int sy = clamp_int(by * 4 + y, 0, image->height - 1);
+                for(int x = 0; x < 4; x++) {
+                    int sx = clamp_int(bx * 4 + x, 0, image->width - 1);
+                    memcpy(block + (y * 4 + x) * 4, image->pixels + ((size_t)sy * image->width + sx) * 4, 4);
+                }
+            }
+
+            unsigned char * out = work->out + ((size_t)by * blocks_x + bx) * block_size;
+            switch(work->format) {
+                case BC_FORMAT_BC1: bc_encode_block_bc1(block, out); break;
+                case BC_FORMAT_BC3: bc_encode_block_bc3(block, out); break;
+                case BC_FORMAT_BC4: bc_encode_block_bc4(block, 0, out); break;
+                case BC_FORMAT_BC5: bc_encode_block_bc5(block, out); break;
+                case BC_FORMAT_BC7: bc_encode_block_bc7(block, out); break;
+                default: panic("Unknown block compression format %d\n", work->format);
+            }
+        }
+    }
+}
+
+static void * encode_thread(void * argument) {
+    encode_rows(argument);
+    return NULL;
+}
+
+#define BC_MAX_THREADS 64
+
+void bc_encode(bc_format_t format, const texture_image_t * image, unsigned char * out, unsigned int thread_count) {
+    int rows = (image->height + 3) / 4;
+    if(thread_count == 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = cores > 0 ? (unsigned int)cores : 1;
+    }
+    if(thread_count > BC_MAX_THREADS) thread_count = BC_MAX_THREADS;
+    if(thread_count > (unsigned int)rows) thread_count = rows;
+
+    bc_work_t work[BC_MAX_THREADS];
+    pthread_t threads[BC_MAX_THREADS];
+    for(unsigned int i = 0; i < thread_count; i++) {
+        work[i].format = format;
+        work[i].image = image;
+        work[i].out = out;
+        work[i].first_row = rows * i / thread_count;
+        work[i].last_row = rows * (i + 1) / thread_count;
+    }
+
+    // The calling thread takes the first share itself
+    for(unsigned int i = 1; i < thread_count; i++) {
+        if(pthread_create(&threads[i], NULL, encode_thread, &work[i]) != 0) panic("Failed to start block compression thread\n");
+    }
+    encode_rows(&work[0]);
+    for(unsigned int i = 1; i < thread_count; i++) pthread_join(threads[i], NULL);
+}
@@ -0,0 +1,104 @@
+#include "draw_commands.h"
+#include "gl_state.h"
+#include "debug.h"
+#include <string.h>
+
+typedef void (APIENTRYP draw_multi_elements_indirect_proc)(GLenum mode, GLenum type, const void * indirect, GLsizei draw_count, GLsizei stride);
+typedef void (APIENTRYP draw_elements_base_instance_proc)(GLenum mode, GLsizei count, GLenum type, const void * indices, GLsizei instance_count, GLint base_vertex, GLuint base_instance);
+
+static draw_multi_elements_indirect_proc multi_draw_elements_indirect = NULL;
+static draw_elements_base_instance_proc draw_elements_base_instance = NULL;
+
+static int has_extension(const char * name) {
+    int count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for(int i = 0; i < count; i++) {
+        if(strcmp((const char *)glGetStringi(GL_EXTENSIONS, i), name) == 0) return 1;
+    }
+    return 0;
+}
+
+int draw_commands_load(GLADloadproc load) {
+    int major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    int version = major * 10 + minor;
+
+    if(version >= 42 || has_extension("GL_ARB_base_instance")) {
+        draw_elements_base_instance = (draw_elements_base_instance_proc)load("glDrawElementsInstancedBaseVertexBaseInstance");
+    }
+    if(version >= 43 || has_extension("GL_ARB_multi_draw_indirect")) {
+        multi_draw_elements_indirect = (draw_multi_elements_indirect_proc)load("glMultiDrawElementsIndirect");
+    }
+    return multi_draw_elements_indirect != NULL;
+}
+
+void draw_commands_init(draw_commands_t * commands, unsigned int capacity, allocator_t * a) {
+    commands->a = a;
+    commands->capacity = capacity > 0 ? capacity : 1;
+    commands->count = 0;
+    commands->commands = allocator_alloc(a, commands->capacity * sizeof(draw_command_t));
+    if(!commands->commands) panic("Failed to allocate %u draw commands\n", commands->capacity);
+    commands->buffer = 0;
+    commands->buffer_size = 0;
+}
+
+void draw_commands_deinit(draw_commands_t * commands) {
+    allocator_free_sized(commands->a, commands->commands, commands->capacity * sizeof(draw_command_t));
+    if(commands->buffer) glDeleteBuffers(1, &commands->buffer);
+}
+
+void draw_commands_reset(draw_commands_t * commands) {
+    commands->count = 0;
+}
+
+void draw_commands_add(draw_commands_t * commands, const draw_command_t * command) {
+    if(commands->count == commands->capacity) {
+        commands->commands = allocator_realloc(commands->a, commands->commands, commands->capacity * 2 * sizeof(draw_command_t));
+        if(!commands->commands) panic("Failed to grow draw commands to %u\n", commands->capacity * 2);
+        commands->capacity *= 2;
+    }
+    commands->commands[commands->count++] = *command;
+}
+
+void draw_commands_add_shape(draw_commands_t * commands, shape_t * shape, unsigned int instance_count, unsigned int base_instance) {
+    if(shape->index_type != GL_UNSIGNED_INT) panic("Draw commands need 32 bit indices, as geometry heaps store them\n");
+    draw_command_t command = {
+        shape->element_count,
+        instance_count,
+        shape->first_index,
+        shape->base_vertex,
+        base_instance,
+    };
+    draw_commands_add(commands, &command);
+}
+
+void draw_commands_submit(draw_commands_t * commands, unsigned int vertex_array, shader_program_t program, shader_uniform_t base_instance_uniform) {
+    if(commands->count == 0) return;
+    gl_state_bind_vertex_array(vertex_array);
+
+    if(multi_draw_elements_indirect) {
+        size_t size = commands->count * sizeof(draw_command_t);
+        if(!commands->buffer) glGenBuffers(1, &commands->buffer);
+        gl_state_bind_buffer(GL_DRAW_INDIRECT_BUFFER, commands->buffer);
+        // Orphaned so the upload does not wait on the draws of the last submit
+        if(size > commands->buffer_size) commands->buffer_size = size;
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commands->buffer_size, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, size, commands->commands);
+
+        multi_draw_elements_indirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void *)0, commands->count, 0);
+        return;
+    }
+
+    for(unsigned int i = 0; i < commands->count; i++) {
+        draw_command_t * command = &commands->commands[i];
+        const void * indices = (void *)(command->first_index * sizeof(unsigned int));
+
+        if(draw_elements_base_instance) {
+            draw_elements_base_instance(GL_TRIANGLES, command->count, GL_UNSIGNED_INT, indices, command->instance_count, command->base_vertex, command->base_instance);
+            continue;
+        }
+        if(base_instance_uniform != -1) shader_program_set_uniform_int(program, base_instance_uniform, command->base_instance);
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command->count, GL_UNSIGNED_INT, indices, command->instance_count, command->base_vertex);
+    }
+}
@@ -0,0 +1,186 @@
+#include "geometry_heap.h"
+#include "gl_state.h"
+#include "debug.h"
+#include <string.h>
+
+static void range_list_init(geometry_range_list_t * list, unsigned int size, allocator_t * a) {
+    list->capacity = 16;
+    list->ranges = allocator_alloc(a, list->capacity * sizeof(geometry_range_t));
+    if(!list->ranges) panic("Failed to allocate geometry heap free list\n");
+    list->ranges[0].start = 0;
+    list->ranges[0].count = size;
+    list->count = size > 0 ? 1 : 0;
+}
+
+static void range_list_insert(geometry_range_list_t * list, unsigned int i, geometry_range_t range, allocator_t * a) {
+    if(list->count == list->capacity) {
+        list->ranges = allocator_realloc(a, list->ranges, list->capacity * 2 * sizeof(geometry_range_t));
+        if(!list->ranges) panic("Failed to grow geometry heap free list\n");
+        list->capacity *= 2;
+    }
+    memmove(&list->ranges[i + 1], &list->ranges[i], (list->count - i) * sizeof(geometry_range_t));
+    list->ranges[i] = range;
+    list->count++;
+}
+
+static void range_list_remove(geometry_range_list_t * list, unsigned int i) {
+    memmove(&list->ranges[i], &list->ranges[i + 1], (list->count - i - 1) * sizeof(geometry_range_t));
+    list->count--;
+}
+
+// First fit, UINT_MAX if nothing is large enough
+static unsigned int range_list_alloc(geometry_range_list_t * list, unsigned int count) {
+    for(unsigned int i = 0; i < list->count; i++) {
+        geometry_range_t * range = &list->ranges[i];
+        if(range->count < count) continue;
+
+        unsigned int start = range->start;
+        range->start += count;
+        range->count -= count;
+        if(range->count == 0) range_list_remove(list, i);
+        return start;
+    }
+    return (unsigned int)-1;
+}
+
+static void range_list_free(geometry_range_list_t * list, geometry_range_t range, allocator_t * a) {
+    if(range.count == 0) return;
+
+    unsigned int i = 0;
+    while(i < list->count && list->ranges[i].start < range.start) i++;
+
+    int merge_before = i > 0 && list->ranges[i - 1].start + list->ranges[i - 1].count == range.start;
+    int merge_after = i < list->count && range.start + range.count == list->ranges[i].start;
+    if(merge_before && merge_after) {
+        list->ranges[i - 1].count += range.count + list->ranges[i].count;
+        range_list_remove(list, i);
+    } else if(merge_before) {
+        list->ranges[i - 1].count += range.count;
+    } else if(merge_after) {
+        list->ranges[i].start = range.start;
+        list->ranges[i].count += range.count;
+    } else {
+        range_list_insert(list, i, range, a);
+    }
+}
+
+// Grows a buffer in place through a temporary copy, keeping its name
+static void grow_buffer(unsigned int buffer, size_t old_size, size_t new_size) {
+    unsigned int temporary;
+    glGenBuffers(1, &temporary);
+    gl_state_bind_buffer(GL_COPY_WRITE_BUFFER, temporary);
+    glBufferData(GL_COPY_WRITE_BUFFER, old_size, NULL, GL_STATIC_COPY);
+    gl_state_bind_buffer(GL_COPY_READ_BUFFER, buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, old_size);
+
+    glBufferData(GL_COPY_READ_BUFFER, new_size, NULL, GL_STATIC_DRAW);
+    glCopyBufferSubData(GL_COPY_WRITE_BUFFER, GL_COPY_READ_BUFFER, 0, 0, old_size);
+    glDeleteBuffers(1, &temporary);
+}
+
+static void grow(geometry_range_list_t * list, unsigned int * capacity, unsigned int needed, unsigned int buffer, size_t element_size, allocator_t * a) {
+    unsigned int new_capacity = *capacity > 0 ? *capacity * 2 : 1024;
+    while(new_capacity < *capacity + needed) new_capacity *= 2;
+
+    grow_buffer(buffer, (size_t)*capacity * element_size, (size_t)new_capacity * element_size);
+    geometry_range_t added = { *capacity, new_capacity - *capacity };
+    range_list_free(list, added, a);
+    *capacity = new_capacity;
+}
+
+void geometry_heap_init(geometry_heap_t * heap, const vertex_layout_t * layout, unsigned int vertex_capacity, unsigned int index_capacity, allocator_t * a) {
+    heap->a = a;
+    heap->layout = *layout;
+    heap->stride = layout->stride;
+    heap->vertex_capacity = vertex_capacity;
+    heap->index_capacity = index_capacity;
+    range_list_init(&heap->free_vertices, vertex_capacity, a);
+    range_list_init(&heap->free_indices, index_capacity, a);
+
+    glGenVertexArrays(1, &heap->VAO);
+    glGenBuffers(1, &heap->VBO);
+    glGenBuffers(1, &heap->EBO);
+
+    gl_state_bind_vertex_array(heap->VAO);
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, heap->VBO);
+    glBufferData(GL_ARRAY_BUFFER, (size_t)vertex_capacity * heap->stride, NULL, GL_STATIC_DRAW);
+    vertex_layout_apply(layout);
+    gl_state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, heap->EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, (size_t)index_capacity * sizeof(unsigned int), NULL, GL_STATIC_DRAW);
+}
+
+void geometry_heap_deinit(geometry_heap_t * heap) {
+    allocator_free_sized(heap->a, heap->free_vertices.ranges, heap->free_vertices.capacity * sizeof(geometry_range_t));
+    allocator_free_sized(heap->a, heap->free_indices.ranges, heap->free_indices.capacity * sizeof(geometry_range_t));
+
+    gl_state_forget_vertex_array(heap->VAO);
+    gl_state_forget_buffer(heap->VBO);
+    gl_state_forget_buffer(heap->EBO);
+    glDeleteVertexArrays(1, &heap->VAO);
+    glDeleteBuffers(1, &heap->VBO);
+    glDeleteBuffers(1, &heap->EBO);
+}
+
+geometry_allocation_t geometry_heap_add(geometry_heap_t * heap, shape_t * shape, void * vertices, unsigned int vertex_count, unsigned int * indices, unsigned int index_count) {
+    geometry_allocation_t allocation;
+
+    unsigned int first_vertex = range_list_alloc(&heap->free_vertices, vertex_count);
+    if(first_vertex == (unsigned int)-1) {
+        grow(&heap->free_vertices, &heap->vertex_capacity, vertex_count, heap->VBO, heap->stride, heap->a);
+        first_vertex = range_list_alloc(&heap->free_vertices, vertex_count);
+    }
+    unsigned int first_index = range_list_alloc(&heap->free_indices, index_count);
+    if(first_index == (unsigned int)-1) {
+        grow(&heap->free_indices, &heap->index_capacity, index_count, heap->EBO, sizeof(unsigned int), heap->a);
+        first_index = range_list_alloc(&heap->free_indices, index_count);
+    }
+
+    // Through the copy targets, binding the EBO would change the element buffer of the bound VAO
+    gl_state_bind_buffer(GL_COPY_WRITE_BUFFER, heap->VBO);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, (size_t)first_vertex * heap->stride, (size_t)vertex_count * heap->stride, vertices);
+    gl_state_bind_buffer(GL_COPY_WRITE_BUFFER, heap->EBO);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, (size_t)first_index * sizeof(unsigned int), (size_t)index_count * sizeof(unsigned int), indices);
+
+    shape->element_count = index_count;
+    shape->index_type = GL_UNSIGNED_INT;
+    shape->base_vertex = (int)first_vertex;
+    shape->first_index = first_index;
+    shape->VAO = heap->VAO;
+    shape->VBO = heap->VBO;
+    shape->EBO = heap->EBO;
+    shape->instance_VBO = 0;
+
+    allocation.vertices.start = first_vertex;
+    allocation.vertices.count = vertex_count;
+    allocation.indices.start = first_index;
+    allocation.indices.count = index_count;
+    return allocation;
+}
+
+void geometry_heap_remove(geometry_heap_t * heap, geometry_allocation_t allocation) {
+    range_list_free(&heap->free_vertices, allocation.vertices, heap->a);
+    range_list_free(&heap->free_indices, allocation.indices, heap->a);
+}
+
+void geometry_heap_set_init(geometry_heap_set_t * set, unsigned int vertex_capacity, unsigned int index_capacity, allocator_t * a) {
+    set->a = a;
+    set->vertex_capacity = vertex_capacity;
+    set->index_capacity = index_capacity;
+    set->count = 0;
+}
+
+void geometry_heap_set_deinit(geometry_heap_set_t * set) {
+    for(unsigned int i = 0; i < set->count; i++) geometry_heap_deinit(&set->heaps[i]);
+    set->count = 0;
+}
+
+geometry_heap_t * geometry_heap_set_get(geometry_heap_set_t * set, const vertex_layout_t * layout) {
+    for(unsigned int i = 0; i < set->count; i++) {
+        if(vertex_layout_equal(&set->heaps[i].layout, layout)) return &set->heaps[i];
+    }
+
+    if(set->count == GEOMETRY_HEAP_SET_MAX_LAYOUTS) panic("More than %d vertex layouts in one geometry heap set\n", GEOMETRY_HEAP_SET_MAX_LAYOUTS);
+    geometry_heap_t * heap = &set->heaps[set->count++];
+    geometry_heap_init(heap, layout, set->vertex_capacity, set->index_capacity, set->a);
+    return heap;
+}
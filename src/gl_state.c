@@ -0,0 +1,164 @@
+#include "gl_state.h"
+#include <string.h>
+
+#define GL_STATE_UNKNOWN 0xFFFFFFFFu
+#define GL_STATE_TEXTURE_UNITS 16
+
+typedef struct gl_state_t gl_state_t;
+
+enum {
+    BUFFER_TARGET_ARRAY,
+    BUFFER_TARGET_ELEMENT_ARRAY,
+    BUFFER_TARGET_PIXEL_UNPACK,
+    BUFFER_TARGET_UNIFORM,
+    BUFFER_TARGET_COUNT
+};
+
+enum {
+    TEXTURE_TARGET_2D,
+    TEXTURE_TARGET_2D_ARRAY,
+    TEXTURE_TARGET_3D,
+    TEXTURE_TARGET_CUBE_MAP,
+    TEXTURE_TARGET_COUNT
+};
+
+struct gl_state_t {
+    unsigned int program;
+    unsigned int vertex_array;
+    unsigned int buffers[BUFFER_TARGET_COUNT];
+    unsigned int active_texture;
+    unsigned int textures[GL_STATE_TEXTURE_UNITS][TEXTURE_TARGET_COUNT];
+    gl_state_stats_t frame;
+    gl_state_stats_t last_frame;
+};
+
+// A fresh context has everything bound to 0 and unit 0 active, which is exactly the zeroed state
+static gl_state_t state;
+
+static int buffer_target_index(GLenum target) {
+    switch(target) {
+        case GL_ARRAY_BUFFER: return BUFFER_TARGET_ARRAY;
+        case GL_ELEMENT_ARRAY_BUFFER: return BUFFER_TARGET_ELEMENT_ARRAY;
+        case GL_PIXEL_UNPACK_BUFFER: return BUFFER_TARGET_PIXEL_UNPACK;
+        case GL_UNIFORM_BUFFER: return BUFFER_TARGET_UNIFORM;
+        default: return -1;
+    }
+}
+
+static int texture_target_index(GLenum target) {
+    switch(target) {
+        case GL_TEXTURE_2D: return TEXTURE_TARGET_2D;
+        case GL_TEXTURE_2D_ARRAY: return TEXTURE_TARGET_2D_ARRAY;
+        case GL_TEXTURE_3D: return TEXTURE_TARGET_3D;
+        case GL_TEXTURE_CUBE_MAP: return TEXTURE_TARGET_CUBE_MAP;
+        default: return -1;
+    }
+}
+
+void gl_state_use_program(unsigned int program) {
+    if(state.program == program) {
+        state.frame.programs.elided++;
+        return;
+    }
+    glUseProgram(program);
+    state.program = program;
+    state.frame.programs.issued++;
+}
+
+void gl_state_bind_vertex_array(unsigned int vertex_array) {
+    if(state.vertex_array == vertex_array) {
+        state.frame.vertex_arrays.elided++;
+        return;
+    }
+    glBindVertexArray(vertex_array);
+    state.vertex_array = vertex_array;
+    // The element array binding is part of the vertex array object
+    state.buffers[BUFFER_TARGET_ELEMENT_ARRAY] = GL_STATE_UNKNOWN;
+    state.frame.vertex_arrays.issued++;
+}
+
+void gl_state_bind_buffer(GLenum target, unsigned int buffer) {
+    int index = buffer_target_index(target);
+    if(index < 0) {
+        glBindBuffer(target, buffer);
+        state.frame.buffers.issued++;
+        return;
+    }
+    if(state.buffers[index] == buffer) {
+        state.frame.buffers.elided++;
+        return;
+    }
+    glBindBuffer(target, buffer);
+    state.buffers[index] = buffer;
+    state.frame.buffers.issued++;
+}
+
+void gl_state_active_texture(unsigned int unit) {
+    if(state.active_texture == unit) return;
+    glActiveTexture(GL_TEXTURE0 + unit);
+    state.active_texture = unit;
+}
+
+void gl_state_bind_texture(GLenum target, unsigned int texture) {
+    int index = texture_target_index(target);
+    unsigned int unit = state.active_texture;
+    if(index < 0 || unit >= GL_STATE_TEXTURE_UNITS) {
+        glBindTexture(target, texture);
+        state.frame.textures.issued++;
+        return;
+    }
+    if(state.textures[unit][index] == texture) {
+        state.frame.textures.elided++;
+        return;
+    }
+    glBindTexture(target, texture);
+    state.textures[unit][index] = texture;
+    state.frame.textures.issued++;
+}
+
+void gl_state_bind_texture_unit(unsigned int unit, GLenum target, unsigned int texture) {
+    gl_state_active_texture(unit);
+    gl_state_bind_texture(target, texture);
+}
+
+void gl_state_forget_program(unsigned int program) {
+    if(state.program == program) state.program = GL_STATE_UNKNOWN;
+}
+
+void gl_state_forget_vertex_array(unsigned int vertex_array) {
+    if(state.vertex_array == vertex_array) {
+        state.vertex_array = GL_STATE_UNKNOWN;
+        state.buffers[BUFFER_TARGET_ELEMENT_ARRAY] = GL_STATE_UNKNOWN;
+    }
+}
+
+void gl_state_forget_buffer(unsigned int buffer) {
+    for(int i = 0; i < BUFFER_TARGET_COUNT; i++) {
+        if(state.buffers[i] == buffer) state.buffers[i] = GL_STATE_UNKNOWN;
+    }
+}
+
+void gl_state_forget_texture(unsigned int texture) {
+    for(int unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++) {
+        for(int i = 0; i < TEXTURE_TARGET_COUNT; i++) {
+            if(state.textures[unit][i] == texture) state.textures[unit][i] = GL_STATE_UNKNOWN;
+        }
+    }
+}
+
+void gl_state_invalidate(void) {
+    state.program = GL_STATE_UNKNOWN;
+    state.vertex_array = GL_STATE_UNKNOWN;
+    for(int i = 0; i < BUFFER_TARGET_COUNT; i++) state.buffers[i] = GL_STATE_UNKNOWN;
+    state.active_texture = GL_STATE_UNKNOWN;
+    memset(state.textures, 0xFF, sizeof(state.textures));
+}
+
+void gl_state_end_frame(void) {
+    state.last_frame = state.frame;
+    memset(&state.frame, 0, sizeof(state.frame));
+}
+
+gl_state_stats_t gl_state_get_stats(void) {
+    return state.last_frame;
+}
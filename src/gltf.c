@@ -0,0 +1,733 @@
+#include "gltf.h"
+#include "json.h"
+#include "io.h"
+#include "gl_state.h"
+#include "debug.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#define GLTF_PATH_LENGTH 4096
+#define GLB_HEADER_SIZE 12
+#define GLB_CHUNK_HEADER_SIZE 8
+#define GLB_CHUNK_JSON 0x4e4f534a
+#define GLB_CHUNK_BIN 0x004e4942
+#define GLTF_MODE_TRIANGLES 4
+
+typedef struct gltf_source_t gltf_source_t;
+typedef struct gltf_view_t gltf_view_t;
+typedef struct gltf_accessor_t gltf_accessor_t;
+typedef struct gltf_parser_t gltf_parser_t;
+
+// The bytes behind a buffer, from the GLB binary chunk, a data uri or a file
+struct gltf_source_t {
+    const char * data;
+    size_t size;
+    io_mapping_t mapping; // data is NULL unless the buffer is a file
+    char * decoded;
+    size_t decoded_capacity;
+};
+
+struct gltf_view_t {
+    const char * data;
+    size_t length;
+    size_t stride; // 0 when tightly packed, as GL takes it
+};
+
+struct gltf_accessor_t {
+    int view; // -1 if the accessor has no buffer view
+    size_t offset;
+    GLenum component_type;
+    size_t count;
+    int components;
+    int normalized;
+    int sparse;
+};
+
+// Everything only needed while loading
+struct gltf_parser_t {
+    gltf_t * gltf;
+    const char * path;
+    size_t directory_length;
+    io_mapping_t mapping;
+    json_t json;
+    const char * bin;
+    size_t bin_size;
+    gltf_source_t * sources;
+    size_t source_count;
+    gltf_view_t * views;
+    size_t view_count;
+    gltf_accessor_t * accessors;
+    size_t accessor_count;
+    int * texture_images; // image of every texture, -1 if it has none
+    size_t texture_count;
+};
+
+static const struct {
+    const char * name;
+    unsigned int location;
+} attributes[] = {
+    { "POSITION", GLTF_LOCATION_POSITION },
+    { "TEXCOORD_0", GLTF_LOCATION_TEXTURE_COORDINATE },
+    { "NORMAL", GLTF_LOCATION_NORMAL },
+    { "COLOR_0", GLTF_LOCATION_COLOUR },
+    { "TANGENT", GLTF_LOCATION_TANGENT },
+};
+
+static void * allocate_array(gltf_parser_t * parser, size_t count, size_t size, const char * what) {
+    if(count == 0) return NULL;
+    void * array = allocator_clean_alloc(parser->gltf->a, count, size);
+    if(!array) panic("Failed to allocate %zu %s for %s\n", count, what, parser->path);
+    return array;
+}
+
+static void free_array(allocator_t * a, void * array, size_t count, size_t size) {
+    if(array) allocator_free_sized(a, array, count * size);
+}
+
+static size_t count_of(const json_value_t * array) {
+    return array && array->type == JSON_ARRAY ? array->child_count : 0;
+}
+
+// glTF only has integers that are counts, offsets or indices, fallback when key is missing
+static long long get_integer(gltf_parser_t * parser, const json_value_t * object, const char * key, long long fallback) {
+    const json_value_t * value = json_get(&parser->json, object, key);
+    if(!value) return fallback;
+    if(value->type != JSON_NUMBER || value->number < 0 || value->number > 9007199254740992.0 || value->number != floor(value->number)) {
+        panic("%s has a %s that is not a count or an index\n", parser->path, key);
+    }
+    return (long long)value->number;
+}
+
+// -1 when key is missing, panics if it is not an index below count
+static int get_index(gltf_parser_t * parser, const json_value_t * object, const char * key, size_t count) {
+    long long index = get_integer(parser, object, key, -1);
+    if(index >= (long long)count) panic("%s has a %s of %lld, there are %zu\n", parser->path, key, index, count);
+    return (int)index;
+}
+
+// Leaves values as they are if array is missing
+static void get_numbers(gltf_parser_t * parser, const json_value_t * object, const char * key, float * values, size_t count) {
+    const json_value_t * array = json_get(&parser->json, object, key);
+    if(!array) return;
+    if(count_of(array) != count) panic("%s has a %s that is not %zu numbers\n", parser->path, key, count);
+
+    size_t i = 0;
+    for(const json_value_t * value = json_first(&parser->json, array); value; value = json_next(&parser->json, value)) {
+        if(value->type != JSON_NUMBER) panic("%s has a %s that is not %zu numbers\n", parser->path, key, count);
+        values[i++] = (float)value->number;
+    }
+}
+
+static size_t component_size(GLenum component_type) {
+    switch(component_type) {
+        case GL_BYTE:
+        case GL_UNSIGNED_BYTE: return 1;
+        case GL_SHORT:
+        case GL_UNSIGNED_SHORT: return 2;
+        case GL_UNSIGNED_INT:
+        case GL_FLOAT: return 4;
+        default: return 0;
+    }
+}
+
+static int component_count(const json_value_t * type) {
+    static const struct {
+        const char * name;
+        int components;
+    } types[] = {
+        { "SCALAR", 1 }, { "VEC2", 2 }, { "VEC3", 3 }, { "VEC4", 4 }, { "MAT2", 4 }, { "MAT3", 9 }, { "MAT4", 16 },
+    };
+    for(size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+        if(json_string_equals(type, types[i].name)) return types[i].components;
+    }
+    return 0;
+}
+
+static int hex_digit(char c) {
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static int base64_value(char c) {
+    if(c >= 'A' && c <= 'Z') return c - 'A';
+    if(c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if(c >= '0' && c <= '9') return c - '0' + 52;
+    if(c == '+') return 62;
+    if(c == '/') return 63;
+    return -1;
+}
+
+static int is_data_uri(const json_value_t * uri) {
+    return uri->length >= 5 && memcmp(uri->string, "data:", 5) == 0;
+}
+
+// Joins uri, with its percent escapes undone, to the directory of the file
+static void resolve_uri(gltf_parser_t * parser, const json_value_t * uri, char * path) {
+    char decoded[GLTF_PATH_LENGTH];
+    size_t length = json_string_copy(uri, decoded, sizeof(decoded));
+    if(length >= sizeof(decoded) || parser->directory_length + length >= GLTF_PATH_LENGTH) {
+        panic("%s refers to a file by a path that is too long\n", parser->path);
+    }
+
+    memcpy(path, parser->path, parser->directory_length);
+    size_t out = parser->directory_length;
+    for(size_t i = 0; i < length; i++) {
+        if(decoded[i] == '%' && i + 2 < length && hex_digit(decoded[i + 1]) >= 0 && hex_digit(decoded[i + 2]) >= 0) {
+            path[out++] = (char)(hex_digit(decoded[i + 1]) * 16 + hex_digit(decoded[i + 2]));
+            i += 2;
+        } else {
+            path[out++] = decoded[i];
+        }
+    }
+    path[out] = 0;
+}
+
+// Decodes a base64 data uri in place, in a copy of capacity bytes that the caller frees
+static char * decode_data_uri(gltf_parser_t * parser, const json_value_t * uri, size_t * size, size_t * capacity) {
+    *capacity = uri->length + 1;
+    char * text = allocator_alloc(parser->gltf->a, *capacity);
+    if(!text) panic("Failed to allocate %zu bytes for a data uri of %s\n", *capacity, parser->path);
+    size_t length = json_string_copy(uri, text, *capacity);
+
+    const char * marker = strstr(text, ";base64,");
+    if(!marker) panic("%s has a data uri that is not base64\n", parser->path);
+
+    // Four characters make three bytes, so the output never catches up with the input
+    size_t out = 0;
+    unsigned int bits = 0;
+    int bit_count = 0;
+    for(const char * in = marker + 8; in < text + length && *in != '='; in++) {
+        int value = base64_value(*in);
+        if(value < 0) panic("%s has malformed base64 in a data uri\n", parser->path);
+        bits = bits << 6 | (unsigned int)value;
+        bit_count += 6;
+        if(bit_count >= 8) {
+            bit_count -= 8;
+            text[out++] = (char)(bits >> bit_count);
+            bits &= (1u << bit_count) - 1;
+        }
+    }
+
+    *size = out;
+    return text;
+}
+
+// Finds the JSON, and the binary chunk if the file is a GLB
+static void read_container(gltf_parser_t * parser, const char ** json, size_t * json_size) {
+    const char * data = parser->mapping.data;
+    size_t size = parser->mapping.size;
+    if(size < GLB_HEADER_SIZE || memcmp(data, "glTF", 4) != 0) {
+        *json = data;
+        *json_size = size;
+        return;
+    }
+
+    uint32_t header[3];
+    memcpy(header, data, sizeof(header));
+    if(header[1] != 2) panic("%s is GLB version %u, expected 2\n", parser->path, header[1]);
+    if(header[2] > size) panic("%s is truncated\n", parser->path);
+    if(header[2] < GLB_HEADER_SIZE) panic("%s has a GLB length of %u, shorter than its header\n", parser->path, header[2]);
+
+    size_t end = header[2];
+    size_t offset = GLB_HEADER_SIZE;
+    unsigned int chunk = 0;
+    while(end - offset >= GLB_CHUNK_HEADER_SIZE) {
+        uint32_t chunk_header[2];
+        memcpy(chunk_header, data + offset, sizeof(chunk_header));
+        offset += GLB_CHUNK_HEADER_SIZE;
+        if(chunk_header[0] > end - offset) panic("%s is truncated\n", parser->path);
+
+        if(chunk == 0) {
+            if(chunk_header[1] != GLB_CHUNK_JSON) panic("%s does not start with a JSON chunk\n", parser->path);
+            *json = data + offset;
+            *json_size = chunk_header[0];
+        } else if(chunk == 1 && chunk_header[1] == GLB_CHUNK_BIN) {
+            parser->bin = data + offset;
+            parser->bin_size = chunk_header[0];
+        }
+        // Chunks of unknown types are skipped
+
+        offset += chunk_header[0];
+        chunk++;
+    }
+    if(chunk == 0) panic("%s has no JSON chunk\n", parser->path);
+}
+
+static void load_sources(gltf_parser_t * parser, const json_value_t * buffers) {
+    parser->source_count = count_of(buffers);
+    parser->sources = allocate_array(parser, parser->source_count, sizeof(gltf_source_t), "buffers");
+
+    size_t i = 0;
+    for(const json_value_t * buffer = json_first(&parser->json, buffers); buffer; buffer = json_next(&parser->json, buffer), i++) {
+        gltf_source_t * source = &parser->sources[i];
+        long long length = get_integer(parser, buffer, "byteLength", -1);
+        if(length < 0) panic("%s has a buffer without byteLength\n", parser->path);
+
+        const json_value_t * uri = json_get(&parser->json, buffer, "uri");
+        size_t size;
+        if(!uri) {
+            // Only the first buffer can be the binary chunk
+            if(i != 0 || !parser->bin) panic("%s has a buffer without uri and no GLB binary chunk for it\n", parser->path);
+            source->data = parser->bin;
+            size = parser->bin_size;
+        } else if(uri->type != JSON_STRING) {
+            panic("%s has a buffer uri that is not a string\n", parser->path);
+        } else if(is_data_uri(uri)) {
+            source->decoded = decode_data_uri(parser, uri, &size, &source->decoded_capacity);
+            source->data = source->decoded;
+        } else {
+            char path[GLTF_PATH_LENGTH];
+            resolve_uri(parser, uri, path);
+            io_map_file(&source->mapping, path, IO_ACCESS_SEQUENTIAL, parser->gltf->a);
+            source->data = source->mapping.data;
+            size = source->mapping.size;
+        }
+
+        if(size < (unsigned long long)length) panic("%s has a buffer of %zu bytes with a byteLength of %lld\n", parser->path, size, length);
+        source->size = (size_t)length;
+    }
+}
+
+static void load_views(gltf_parser_t * parser, const json_value_t * views) {
+    parser->view_count = count_of(views);
+    parser->views = allocate_array(parser, parser->view_count, sizeof(gltf_view_t), "buffer views");
+
+    size_t i = 0;
+    for(const json_value_t * value = json_first(&parser->json, views); value; value = json_next(&parser->json, value), i++) {
+        int buffer = get_index(parser, value, "buffer", parser->source_count);
+        long long offset = get_integer(parser, value, "byteOffset", 0);
+        long long length = get_integer(parser, value, "byteLength", -1);
+        if(buffer < 0 || length < 0) panic("%s has a buffer view without buffer or byteLength\n", parser->path);
+
+        const gltf_source_t * source = &parser->sources[buffer];
+        if((unsigned long long)offset > source->size || (unsigned long long)length > source->size - offset) {
+            panic("%s has a buffer view past the end of buffer %d\n", parser->path, buffer);
+        }
+
+        parser->views[i].data = source->data + offset;
+        parser->views[i].length = (size_t)length;
+        // Strides outside what the spec allows could overflow the bounds checks of accessors
+        long long stride = get_integer(parser, value, "byteStride", 0);
+        if(stride != 0 && (stride < 4 || stride > 252 || stride % 4 != 0)) {
+            panic("%s has a buffer view with a byteStride of %lld, not a multiple of 4 from 4 to 252\n", parser->path, stride);
+        }
+        parser->views[i].stride = (size_t)stride;
+    }
+}
+
+static void load_accessors(gltf_parser_t * parser, const json_value_t * accessors) {
+    parser->accessor_count = count_of(accessors);
+    parser->accessors = allocate_array(parser, parser->accessor_count, sizeof(gltf_accessor_t), "accessors");
+
+    size_t i = 0;
+    for(const json_value_t * value = json_first(&parser->json, accessors); value; value = json_next(&parser->json, value), i++) {
+        gltf_accessor_t * accessor = &parser->accessors[i];
+        accessor->view = get_index(parser, value, "bufferView", parser->view_count);
+        accessor->offset = (size_t)get_integer(parser, value, "byteOffset", 0);
+        accessor->component_type = (GLenum)get_integer(parser, value, "componentType", 0);
+        accessor->count = (size_t)get_integer(parser, value, "count", 0);
+        accessor->components = component_count(json_get(&parser->json, value, "type"));
+        const json_value_t * normalized = json_get(&parser->json, value, "normalized");
+        accessor->normalized = normalized && normalized->type == JSON_TRUE;
+        accessor->sparse = json_get(&parser->json, value, "sparse") != NULL;
+
+        if(component_size(accessor->component_type) == 0 || accessor->components == 0) {
+            panic("%s has accessor %zu of unknown type\n", parser->path, i);
+        }
+    }
+}
+
+// Uploads the view into its own buffer the first time geometry reads from it
+static unsigned int view_buffer(gltf_parser_t * parser, int view) {
+    unsigned int * buffer = &parser->gltf->buffers[view];
+    if(!*buffer) {
+        glGenBuffers(1, buffer);
+        gl_state_bind_buffer(GL_ARRAY_BUFFER, *buffer);
+        glBufferData(GL_ARRAY_BUFFER, parser->views[view].length, parser->views[view].data, GL_STATIC_DRAW);
+    }
+    return *buffer;
+}
+
+// An accessor that GL can read straight out of its view
+static const gltf_accessor_t * geometry_accessor(gltf_parser_t * parser, int index) {
+    const gltf_accessor_t * accessor = &parser->accessors[index];
+    if(accessor->sparse) panic("%s has sparse accessor %d, sparse accessors are not supported\n", parser->path, index);
+    if(accessor->view < 0) panic("%s has accessor %d without a buffer view\n", parser->path, index);
+
+    const gltf_view_t * view = &parser->views[accessor->view];
+    size_t size = component_size(accessor->component_type);
+    size_t element = size * accessor->components;
+    size_t stride = view->stride ? view->stride : element;
+    if(accessor->offset % size != 0) panic("%s has accessor %d misaligned in its buffer view\n", parser->path, index);
+    if(accessor->count > 0 && (accessor->count > view->length || accessor->offset > view->length ||
+                               (accessor->count - 1) * stride + element > view->length - accessor->offset)) {
+        panic("%s has accessor %d reaching past its buffer view\n", parser->path, index);
+    }
+    return accessor;
+}
+
+static int is_triangles(gltf_parser_t * parser, const json_value_t * primitive) {
+    return get_integer(parser, primitive, "mode", GLTF_MODE_TRIANGLES) == GLTF_MODE_TRIANGLES;
+}
+
+static void load_primitive(gltf_parser_t * parser, const json_value_t * value, gltf_primitive_t * primitive) {
+    const json_value_t * attribute_values = json_get(&parser->json, value, "attributes");
+    int position = get_index(parser, attribute_values, "POSITION", parser->accessor_count);
+    if(position < 0) panic("%s has a primitive without POSITION\n", parser->path);
+    const gltf_accessor_t * position_accessor = geometry_accessor(parser, position);
+    unsigned int VBO = view_buffer(parser, position_accessor->view);
+
+    int indices = get_index(parser, value, "indices", parser->accessor_count);
+    shape_t * shape = &primitive->shape;
+    if(indices >= 0) {
+        const gltf_accessor_t * accessor = geometry_accessor(parser, indices);
+        GLenum type = accessor->component_type;
+        if(accessor->components != 1 || (type != GL_UNSIGNED_BYTE && type != GL_UNSIGNED_SHORT && type != GL_UNSIGNED_INT)) {
+            panic("%s has indices that are not unsigned integers\n", parser->path);
+        }
+
+        // The index view is the EBO, the accessor only picks where in it to start
+        shape_init_from_buffers(shape, VBO, view_buffer(parser, accessor->view));
+        shape->index_type = type;
+        shape->first_index = accessor->offset / component_size(type);
+        shape->element_count = accessor->count;
+    } else {
+        size_t count = position_accessor->count;
+        unsigned int * sequence = allocate_array(parser, count, sizeof(unsigned int), "indices");
+        for(size_t i = 0; i < count; i++) sequence[i] = (unsigned int)i;
+
+        shape_init_from_buffers(shape, VBO, 0);
+        glGenBuffers(1, &shape->EBO);
+        shape_load_indices(shape, sequence, count * sizeof(unsigned int));
+        primitive->owns_indices = 1;
+        free_array(parser->gltf->a, sequence, count, sizeof(unsigned int));
+    }
+
+    for(size_t i = 0; i < sizeof(attributes) / sizeof(attributes[0]); i++) {
+        int index = get_index(parser, attribute_values, attributes[i].name, parser->accessor_count);
+        if(index < 0) continue;
+
+        const gltf_accessor_t * accessor = geometry_accessor(parser, index);
+        if(accessor->components > 4) panic("%s has a %s attribute that is a matrix\n", parser->path, attributes[i].name);
+        shape_interpret_buffer_and_enable(shape, view_buffer(parser, accessor->view), attributes[i].location, accessor->components,
+                                          accessor->component_type, accessor->normalized ? GL_TRUE : GL_FALSE,
+                                          parser->views[accessor->view].stride, (void *)accessor->offset);
+    }
+
+    primitive->material = get_index(parser, value, "material", parser->gltf->material_count);
+}
+
+static void load_meshes(gltf_parser_t * parser, const json_value_t * meshes) {
+    gltf_t * gltf = parser->gltf;
+    gltf->mesh_count = count_of(meshes);
+    gltf->meshes = allocate_array(parser, gltf->mesh_count, sizeof(gltf_mesh_t), "meshes");
+
+    // Points, lines and strips are left out, shapes only draw triangle lists
+    size_t primitive_count = 0;
+    for(const json_value_t * mesh = json_first(&parser->json, meshes); mesh; mesh = json_next(&parser->json, mesh)) {
+        const json_value_t * primitives = json_get(&parser->json, mesh, "primitives");
+        for(const json_value_t * primitive = json_first(&parser->json, primitives); primitive; primitive = json_next(&parser->json, primitive)) {
+            if(is_triangles(parser, primitive)) primitive_count++;
+        }
+    }
+    gltf->primitives = allocate_array(parser, primitive_count, sizeof(gltf_primitive_t), "primitives");
+
+    size_t i = 0;
+    for(const json_value_t * mesh = json_first(&parser->json, meshes); mesh; mesh = json_next(&parser->json, mesh), i++) {
+        gltf->meshes[i].first_primitive = gltf->primitive_count;
+        const json_value_t * primitives = json_get(&parser->json, mesh, "primitives");
+        for(const json_value_t * primitive = json_first(&parser->json, primitives); primitive; primitive = json_next(&parser->json, primitive)) {
+            if(!is_triangles(parser, primitive)) continue;
+            load_primitive(parser, primitive, &gltf->primitives[gltf->primitive_count++]);
+        }
+        gltf->meshes[i].primitive_count = gltf->primitive_count - gltf->meshes[i].first_primitive;
+    }
+}
+
+static void load_images(gltf_parser_t * parser, const json_value_t * images, texture_loader_t * loader) {
+    gltf_t * gltf = parser->gltf;
+    gltf->image_count = count_of(images);
+    gltf->images = allocate_array(parser, gltf->image_count, sizeof(texture_t), "images");
+    if(!loader) return;
+
+    size_t i = 0;
+    for(const json_value_t * image = json_first(&parser->json, images); image; image = json_next(&parser->json, image), i++) {
+        char name[GLTF_PATH_LENGTH];
+        snprintf(name, sizeof(name), "%s image %zu", parser->path, i);
+
+        const json_value_t * uri = json_get(&parser->json, image, "uri");
+        int view = get_index(parser, image, "bufferView", parser->view_count);
+        if(uri && uri->type == JSON_STRING && is_data_uri(uri)) {
+            size_t size, capacity;
+            char * data = decode_data_uri(parser, uri, &size, &capacity);
+            texture_load_async_memory(loader, &gltf->images[i], name, data, size, ASYNC_IO_PRIORITY_NORMAL);
+            allocator_free_sized(gltf->a, data, capacity);
+        } else if(uri && uri->type == JSON_STRING) {
+            char path[GLTF_PATH_LENGTH];
+            resolve_uri(parser, uri, path);
+            texture_load_async(loader, &gltf->images[i], path, ASYNC_IO_PRIORITY_NORMAL);
+        } else if(view >= 0) {
+            texture_load_async_memory(loader, &gltf->images[i], name, parser->views[view].data, parser->views[view].length, ASYNC_IO_PRIORITY_NORMAL);
+        } else {
+            panic("%s has image %zu without uri or bufferView\n", parser->path, i);
+        }
+    }
+}
+
+static void load_textures(gltf_parser_t * parser, const json_value_t * textures) {
+    parser->texture_count = count_of(textures);
+    parser->texture_images = allocate_array(parser, parser->texture_count, sizeof(int), "textures");
+
+    size_t i = 0;
+    for(const json_value_t * texture = json_first(&parser->json, textures); texture; texture = json_next(&parser->json, texture), i++) {
+        // Without source the image comes from an extension, which is not loaded
+        parser->texture_images[i] = get_index(parser, texture, "source", parser->gltf->image_count);
+    }
+}
+
+static void load_materials(gltf_parser_t * parser, const json_value_t * materials) {
+    gltf_t * gltf = parser->gltf;
+    gltf->material_count = count_of(materials);
+    gltf->materials = allocate_array(parser, gltf->material_count, sizeof(gltf_material_t), "materials");
+
+    size_t i = 0;
+    for(const json_value_t * value = json_first(&parser->json, materials); value; value = json_next(&parser->json, value), i++) {
+        gltf_material_t * material = &gltf->materials[i];
+        for(int c = 0; c < 4; c++) material->base_colour[c] = 1.0f;
+
+        const json_value_t * pbr = json_get(&parser->json, value, "pbrMetallicRoughness");
+        get_numbers(parser, pbr, "baseColorFactor", material->base_colour, 4);
+        int texture = get_index(parser, json_get(&parser->json, pbr, "baseColorTexture"), "index", parser->texture_count);
+        if(texture >= 0 && parser->texture_images[texture] >= 0) {
+            material->base_colour_texture = gltf->images[parser->texture_images[texture]];
+        }
+    }
+}
+
+static void multiply(float * out, const float * a, const float * b) {
+    for(int column = 0; column < 4; column++) {
+        for(int row = 0; row < 4; row++) {
+            float sum = 0.0f;
+            for(int k = 0; k < 4; k++) sum += a[k * 4 + row] * b[column * 4 + k];
+            out[column * 4 + row] = sum;
+        }
+    }
+}
+
+// T * R * S, the order glTF composes them in
+static void compose(float * m, const float * t, const float * r, const float * s) {
+    float x = r[0], y = r[1], z = r[2], w = r[3];
+
+    m[0] = (1.0f - 2.0f * (y * y + z * z)) * s[0];
+    m[1] = 2.0f * (x * y + z * w) * s[0];
+    m[2] = 2.0f * (x * z - y * w) * s[0];
+    m[3] = 0.0f;
+    m[4] = 2.0f * (x * y - z * w) * s[1];
+    m[5] = (1.0f - 2.0f * (x * x + z * z)) * s[1];
+    m[6] = 2.0f * (y * z + x * w) * s[1];
+    m[7] = 0.0f;
+    m[8] = 2.0f * (x * z + y * w) * s[2];
+    m[9] = 2.0f * (y * z - x * w) * s[2];
+    m[10] = (1.0f - 2.0f * (x * x + y * y)) * s[2];
+    m[11] = 0.0f;
+    m[12] = t[0];
+    m[13] = t[1];
+    m[14] = t[2];
+    m[15] = 1.0f;
+}
+
+static void load_nodes(gltf_parser_t * parser, const json_value_t * root) {
+    gltf_t * gltf = parser->gltf;
+    const json_value_t * node_array = json_get(&parser->json, root, "nodes");
+    size_t count = count_of(node_array);
+    if(count == 0) return;
+
+    const json_value_t ** nodes = allocate_array(parser, count, sizeof(json_value_t *), "nodes");
+    int * parents = allocate_array(parser, count, sizeof(int), "nodes");
+    int * flat = allocate_array(parser, count, sizeof(int), "nodes"); // -1 until pushed, then -2 until visited
+    int * order = allocate_array(parser, count, sizeof(int), "nodes");
+    int * stack = allocate_array(parser, count, sizeof(int), "nodes");
+    size_t i = 0;
+    for(const json_value_t * node = json_first(&parser->json, node_array); node; node = json_next(&parser->json, node), i++) {
+        nodes[i] = node;
+        parents[i] = -1;
+        flat[i] = -1;
+    }
+
+    // With one parent per node and parentless roots the traversal cannot loop
+    for(i = 0; i < count; i++) {
+        const json_value_t * children = json_get(&parser->json, nodes[i], "children");
+        for(const json_value_t * child = json_first(&parser->json, children); child; child = json_next(&parser->json, child)) {
+            double index = json_number(child, -1.0);
+            if(index < 0 || index >= count || index != floor(index)) panic("%s has node %zu with a child that is not a node\n", parser->path, i);
+            if(parents[(size_t)index] >= 0 || (size_t)index == i) panic("%s has node %zu with more than one parent\n", parser->path, (size_t)index);
+            parents[(size_t)index] = (int)i;
+        }
+    }
+
+    // The roots go on the stack last to first, so they come off first to last
+    size_t stack_size = 0;
+    const json_value_t * scenes = json_get(&parser->json, root, "scenes");
+    int scene = get_index(parser, root, "scene", count_of(scenes));
+    if(scene < 0 && count_of(scenes) > 0) scene = 0;
+    if(scene >= 0) {
+        const json_value_t * scene_value = json_first(&parser->json, scenes);
+        for(int s = 0; s < scene; s++) scene_value = json_next(&parser->json, scene_value);
+        const json_value_t * roots = json_get(&parser->json, scene_value, "nodes");
+        for(const json_value_t * value = json_first(&parser->json, roots); value; value = json_next(&parser->json, value)) {
+            double index = json_number(value, -1.0);
+            if(index < 0 || index >= count || index != floor(index)) panic("%s has a scene root that is not a node\n", parser->path);
+            if(parents[(size_t)index] >= 0) panic("%s has node %zu as a scene root and as a child\n", parser->path, (size_t)index);
+            if(flat[(size_t)index] != -1) panic("%s lists node %zu as a scene root twice\n", parser->path, (size_t)index);
+            flat[(size_t)index] = -2;
+            stack[stack_size++] = (int)index;
+        }
+        for(size_t r = 0; r < stack_size / 2; r++) {
+            int swap = stack[r];
+            stack[r] = stack[stack_size - 1 - r];
+            stack[stack_size - 1 - r] = swap;
+        }
+    } else {
+        for(i = count; i-- > 0;) {
+            if(parents[i] < 0) stack[stack_size++] = (int)i;
+        }
+    }
+
+    // Every node is pushed at most once, so the stack never holds more than count
+    size_t flat_count = 0;
+    while(stack_size > 0) {
+        int node = stack[--stack_size];
+        flat[node] = (int)flat_count;
+        order[flat_count++] = node;
+
+        const json_value_t * children = json_get(&parser->json, nodes[node], "children");
+        stack_size += count_of(children);
+        size_t c = stack_size;
+        for(const json_value_t * child = json_first(&parser->json, children); child; child = json_next(&parser->json, child)) {
+            stack[--c] = (int)child->number;
+        }
+    }
+
+    gltf->node_count = flat_count;
+    gltf->nodes = allocate_array(parser, flat_count, sizeof(gltf_node_t), "nodes");
+    for(i = 0; i < flat_count; i++) {
+        gltf_node_t * node = &gltf->nodes[i];
+        const json_value_t * value = nodes[order[i]];
+        int parent = parents[order[i]];
+
+        node->source = order[i];
+        node->parent = parent >= 0 ? flat[parent] : -1;
+        node->mesh = get_index(parser, value, "mesh", gltf->mesh_count);
+
+        if(json_get(&parser->json, value, "matrix")) {
+            get_numbers(parser, value, "matrix", node->local, 16);
+        } else {
+            float translation[3] = { 0.0f, 0.0f, 0.0f };
+            float rotation[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+            float scale[3] = { 1.0f, 1.0f, 1.0f };
+            get_numbers(parser, value, "translation", translation, 3);
+            get_numbers(parser, value, "rotation", rotation, 4);
+            get_numbers(parser, value, "scale", scale, 3);
+            compose(node->local, translation, rotation, scale);
+        }
+    }
+
+    free_array(gltf->a, stack, count, sizeof(int));
+    free_array(gltf->a, order, count, sizeof(int));
+    free_array(gltf->a, flat, count, sizeof(int));
+    free_array(gltf->a, parents, count, sizeof(int));
+    free_array(gltf->a, nodes, count, sizeof(json_value_t *));
+
+    gltf_update_world(gltf);
+}
+
+void gltf_load(gltf_t * gltf, const char * path, texture_loader_t * loader, allocator_t * a) {
+    memset(gltf, 0, sizeof(*gltf));
+    gltf->a = a;
+
+    gltf_parser_t parser;
+    memset(&parser, 0, sizeof(parser));
+    parser.gltf = gltf;
+    parser.path = path;
+    const char * slash = strrchr(path, '/');
+    parser.directory_length = slash ? (size_t)(slash - path + 1) : 0;
+
+    io_map_file(&parser.mapping, path, IO_ACCESS_SEQUENTIAL, a);
+    const char * text;
+    size_t text_size;
+    read_container(&parser, &text, &text_size);
+    if(!json_parse(&parser.json, text, text_size, a)) {
+        panic("%s is not valid JSON, %s at byte %zu\n", path, parser.json.error, parser.json.error_offset);
+    }
+
+    const json_value_t * root = json_root(&parser.json);
+    const json_value_t * version = json_get(&parser.json, json_get(&parser.json, root, "asset"), "version");
+    if(!version || version->type != JSON_STRING || version->length < 2 || memcmp(version->string, "2.", 2) != 0) {
+        panic("%s is not a glTF 2 file\n", path);
+    }
+
+    load_sources(&parser, json_get(&parser.json, root, "buffers"));
+    load_views(&parser, json_get(&parser.json, root, "bufferViews"));
+    load_accessors(&parser, json_get(&parser.json, root, "accessors"));
+
+    gltf->buffer_count = parser.view_count;
+    gltf->buffers = allocate_array(&parser, gltf->buffer_count, sizeof(unsigned int), "buffers");
+    load_images(&parser, json_get(&parser.json, root, "images"), loader);
+    load_textures(&parser, json_get(&parser.json, root, "textures"));
+    load_materials(&parser, json_get(&parser.json, root, "materials"));
+    load_meshes(&parser, json_get(&parser.json, root, "meshes"));
+    load_nodes(&parser, root);
+
+    // Everything is in GL buffers or copied to the texture loader by now
+    for(size_t i = 0; i < parser.source_count; i++) {
+        gltf_source_t * source = &parser.sources[i];
+        if(source->mapping.data) io_unmap_file(&source->mapping);
+        if(source->decoded) allocator_free_sized(a, source->decoded, source->decoded_capacity);
+    }
+    free_array(a, parser.texture_images, parser.texture_count, sizeof(int));
+    free_array(a, parser.accessors, parser.accessor_count, sizeof(gltf_accessor_t));
+    free_array(a, parser.views, parser.view_count, sizeof(gltf_view_t));
+    free_array(a, parser.sources, parser.source_count, sizeof(gltf_source_t));
+    json_free(&parser.json);
+    io_unmap_file(&parser.mapping);
+}
+
+void gltf_free(gltf_t * gltf) {
+    for(size_t i = 0; i < gltf->primitive_count; i++) {
+        shape_t * shape = &gltf->primitives[i].shape;
+        gl_state_forget_vertex_array(shape->VAO);
+        glDeleteVertexArrays(1, &shape->VAO);
+        if(gltf->primitives[i].owns_indices) {
+            gl_state_forget_buffer(shape->EBO);
+            glDeleteBuffers(1, &shape->EBO);
+        }
+    }
+    for(size_t i = 0; i < gltf->buffer_count; i++) {
+        if(!gltf->buffers[i]) continue;
+        gl_state_forget_buffer(gltf->buffers[i]);
+        glDeleteBuffers(1, &gltf->buffers[i]);
+    }
+    for(size_t i = 0; i < gltf->image_count; i++) {
+        if(gltf->images[i]) texture_delete(gltf->images[i]);
+    }
+
+    free_array(gltf->a, gltf->nodes, gltf->node_count, sizeof(gltf_node_t));
+    free_array(gltf->a, gltf->images, gltf->image_count, sizeof(texture_t));
+    free_array(gltf->a, gltf->materials, gltf->material_count, sizeof(gltf_material_t));
+    free_array(gltf->a, gltf->meshes, gltf->mesh_count, sizeof(gltf_mesh_t));
+    free_array(gltf->a, gltf->primitives, gltf->primitive_count, sizeof(gltf_primitive_t));
+    free_array(gltf->a, gltf->buffers, gltf->buffer_count, sizeof(unsigned int));
+    memset(gltf, 0, sizeof(*gltf));
+}
+
+void gltf_update_world(gltf_t * gltf) {
+    for(size_t i = 0; i < gltf->node_count; i++) {
+        gltf_node_t * node = &gltf->nodes[i];
+        if(node->parent < 0) memcpy(node->world, node->local, sizeof(node->world));
+        else multiply(node->world, gltf->nodes[node->parent].world, node->local);
+    }
+}
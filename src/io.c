@@ -1,20 +1,126 @@
 #include "io.h"
 #include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "debug.h"
 
-char * read_entire_file(const char * path, allocator_t * a) {
-    FILE * f = fopen(path, "r");
-    if(!f) panic("Failed to open file %s\n", path);
+static int open_file(const char * path, size_t * size) {
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) panic("Failed to open file %s\n", path);
+
+    struct stat st;
+    if(fstat(fd, &st) != 0) panic("Failed to stat file %s\n", path);
+    *size = (size_t)st.st_size;
+
+    return fd;
+}
 
-    fseek(f, 0, SEEK_END);
-    long size = ftell(f) + 1;
-    rewind(f);
+// Reads straight into an uninitialised buffer, there is no point zeroing what is overwritten anyway
+static char * read_into_buffer(int fd, const char * path, size_t size, allocator_t * a) {
+    char * buffer = allocator_alloc(a, size + 1);
+    if(!buffer) panic("Failed to allocate %zu bytes for file %s\n", size + 1, path);
 
-    char * buffer = allocator_clean_alloc(a, size + 1, sizeof(char));
-    fread(buffer, size, 1, f);
+    size_t done = 0;
+    while(done < size) {
+        ssize_t n = read(fd, buffer + done, size - done);
+        if(n <= 0) panic("Failed to read file %s\n", path);
+        done += n;
+    }
     buffer[size] = 0;
 
-    fclose(f);
+    return buffer;
+}
+
+char * read_entire_file_sized(const char * path, size_t * size, allocator_t * a) {
+    int fd = open_file(path, size);
+    char * buffer = read_into_buffer(fd, path, *size, a);
+    close(fd);
 
     return buffer;
-} 
+}
+
+char * read_entire_file(const char * path, allocator_t * a) {
+    size_t size;
+    return read_entire_file_sized(path, &size, a);
+}
+
+void io_map_file(io_mapping_t * mapping, const char * path, io_access_t access, allocator_t * a) {
+    size_t size;
+    int fd = open_file(path, &size);
+
+    mapping->size = size;
+    mapping->a = a;
+
+    // mmap refuses empty files, those and anything else that cannot be mapped are read instead
+    void * data = size ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    if(data != MAP_FAILED) {
+        if(access == IO_ACCESS_SEQUENTIAL) {
+            madvise(data, size, MADV_SEQUENTIAL);
+            madvise(data, size, MADV_WILLNEED);
+        } else {
+            madvise(data, size, MADV_RANDOM);
+        }
+        mapping->data = data;
+        mapping->is_mapped = 1;
+    } else {
+        mapping->data = read_into_buffer(fd, path, size, a);
+        mapping->is_mapped = 0;
+    }
+
+    close(fd);
+}
+
+void io_unmap_file(io_mapping_t * mapping) {
+    if(mapping->is_mapped) munmap((void *)mapping->data, mapping->size);
+    else allocator_free_sized(mapping->a, (void *)mapping->data, mapping->size + 1);
+
+    mapping->data = NULL;
+    mapping->size = 0;
+}
+
+void io_stream_open(io_stream_t * stream, const char * path, size_t chunk_size, unsigned int readahead) {
+    stream->fd = open_file(path, &stream->size);
+    stream->offset = 0;
+    stream->chunk_size = chunk_size;
+    stream->readahead = readahead;
+    stream->prefetched = 0;
+
+    posix_fadvise(stream->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+size_t io_stream_read(io_stream_t * stream, void * buffer, size_t buffer_size) {
+    if(stream->offset >= stream->size) return 0;
+
+    size_t wanted = stream->chunk_size < buffer_size ? stream->chunk_size : buffer_size;
+    if(wanted > stream->size - stream->offset) wanted = stream->size - stream->offset;
+
+    // Keep readahead chunks in flight past this one so the disk works while the caller parses
+    size_t window = stream->offset + wanted + (size_t)stream->readahead * stream->chunk_size;
+    if(window > stream->size) window = stream->size;
+    if(window > stream->prefetched) {
+        size_t from = stream->prefetched > stream->offset ? stream->prefetched : stream->offset;
+        posix_fadvise(stream->fd, from, window - from, POSIX_FADV_WILLNEED);
+        stream->prefetched = window;
+    }
+
+    size_t done = 0;
+    while(done < wanted) {
+        ssize_t n = pread(stream->fd, (char *)buffer + done, wanted - done, stream->offset + done);
+        if(n < 0) panic("Failed to read chunk at offset %zu\n", stream->offset + done);
+        if(n == 0) break;
+        done += n;
+    }
+
+    // The caller has its own copy now, the page cache does not need to hold on to it
+    posix_fadvise(stream->fd, stream->offset, done, POSIX_FADV_DONTNEED);
+    stream->offset += done;
+
+    return done;
+}
+
+void io_stream_close(io_stream_t * stream) {
+    close(stream->fd);
+    stream->fd = -1;
+}
@@ -0,0 +1,312 @@
+#include "json.h"
+#include "debug.h"
+#include <string.h>
+#include <stdlib.h>
+
+#define JSON_MAX_DEPTH 256
+
+typedef struct json_parser_t json_parser_t;
+
+struct json_parser_t {
+    json_t * json;
+    const char * text;
+    const char * p;
+    const char * end;
+};
+
+static int fail(json_parser_t * parser, const char * error) {
+    if(!parser->json->error) {
+        parser->json->error = error;
+        parser->json->error_offset = parser->p - parser->text;
+    }
+    return 0;
+}
+
+static uint32_t new_value(json_parser_t * parser, json_type_t type) {
+    json_t * json = parser->json;
+    if(json->count == json->capacity) {
+        size_t capacity = json->capacity ? json->capacity * 2 : 256;
+        json->values = allocator_realloc(json->a, json->values, capacity * sizeof(json_value_t));
+        if(!json->values) panic("Failed to grow JSON to %zu values\n", capacity);
+        json->capacity = capacity;
+    }
+    json_value_t * value = &json->values[json->count];
+    memset(value, 0, sizeof(*value));
+    value->type = type;
+    value->first_child = JSON_NONE;
+    value->next = JSON_NONE;
+    return (uint32_t)json->count++;
+}
+
+static void skip_space(json_parser_t * parser) {
+    while(parser->p < parser->end && (*parser->p == ' ' || *parser->p == '\t' || *parser->p == '\n' || *parser->p == '\r')) parser->p++;
+}
+
+// Leaves p after the closing quote, string and length cover what is in between
+static int parse_string(json_parser_t * parser, const char ** string, size_t * length, int * escaped) {
+    const char * p = parser->p + 1;
+    *escaped = 0;
+    while(p < parser->end && *p != '"') {
+        if((unsigned char)*p < 0x20) {
+            parser->p = p;
+            return fail(parser, "control character in string");
+        }
+        if(*p == '\\') {
+            *escaped = 1;
+            p++;
+        }
+        p++;
+    }
+    if(p >= parser->end) return fail(parser, "unterminated string");
+    *string = parser->p + 1;
+    *length = p - *string;
+    parser->p = p + 1;
+    return 1;
+}
+
+static int parse_number(json_parser_t * parser, double * number) {
+    char buffer[64];
+    size_t length = 0;
+    const char * p = parser->p;
+    while(p < parser->end && length + 1 < sizeof(buffer) && strchr("+-0123456789.eE", *p)) buffer[length++] = *p++;
+    buffer[length] = 0;
+
+    char * number_end;
+    *number = strtod(buffer, &number_end);
+    if(length == 0 || number_end != buffer + length) return fail(parser, "malformed number");
+    parser->p = p;
+    return 1;
+}
+
+static int match(json_parser_t * parser, const char * word) {
+    size_t length = strlen(word);
+    if((size_t)(parser->end - parser->p) < length || memcmp(parser->p, word, length) != 0) return 0;
+    parser->p += length;
+    return 1;
+}
+
+static int parse_value(json_parser_t * parser, uint32_t * index, int depth);
+
+// Parses members up to close, key_value set for objects
+static int parse_members(json_parser_t * parser, uint32_t container, char close, int depth) {
+    parser->p++;
+    skip_space(parser);
+    if(parser->p < parser->end && *parser->p == close) {
+        parser->p++;
+        return 1;
+    }
+
+    uint32_t last = JSON_NONE;
+    for(;;) {
+        const char * key = NULL;
+        size_t key_length = 0;
+        if(close == '}') {
+            int escaped;
+            if(parser->p >= parser->end || *parser->p != '"') return fail(parser, "expected a key");
+            if(!parse_string(parser, &key, &key_length, &escaped)) return 0;
+            skip_space(parser);
+            if(parser->p >= parser->end || *parser->p != ':') return fail(parser, "expected ':'");
+            parser->p++;
+        }
+
+        uint32_t member;
+        if(!parse_value(parser, &member, depth + 1)) return 0;
+        json_value_t * values = parser->json->values;
+        values[member].key = key;
+        values[member].key_length = key_length;
+        if(last == JSON_NONE) values[container].first_child = member;
+        else values[last].next = member;
+        values[container].child_count++;
+        last = member;
+
+        skip_space(parser);
+        if(parser->p < parser->end && *parser->p == ',') {
+            parser->p++;
+            skip_space(parser);
+            continue;
+        }
+        if(parser->p < parser->end && *parser->p == close) {
+            parser->p++;
+            return 1;
+        }
+        return fail(parser, close == '}' ? "expected ',' or '}'" : "expected ',' or ']'");
+    }
+}
+
+static int parse_value(json_parser_t * parser, uint32_t * index, int depth) {
+    if(depth > JSON_MAX_DEPTH) return fail(parser, "nested too deep");
+    skip_space(parser);
+    if(parser->p >= parser->end) return fail(parser, "expected a value");
+
+    switch(*parser->p) {
+        case '{':
+            *index = new_value(parser, JSON_OBJECT);
+            return parse_members(parser, *index, '}', depth);
+        case '[':
+            *index = new_value(parser, JSON_ARRAY);
+            return parse_members(parser, *index, ']', depth);
+        case '"': {
+            *index = new_value(parser, JSON_STRING);
+            const char * string;
+            size_t length;
+            int escaped;
+            if(!parse_string(parser, &string, &length, &escaped)) return 0;
+            json_value_t * value = &parser->json->values[*index];
+            value->string = string;
+            value->length = length;
+            value->escaped = escaped;
+            return 1;
+        }
+        case 't':
+            *index = new_value(parser, JSON_TRUE);
+            return match(parser, "true") || fail(parser, "expected a value");
+        case 'f':
+            *index = new_value(parser, JSON_FALSE);
+            return match(parser, "false") || fail(parser, "expected a value");
+        case 'n':
+            *index = new_value(parser, JSON_NULL);
+            return match(parser, "null") || fail(parser, "expected a value");
+        default: {
+            *index = new_value(parser, JSON_NUMBER);
+            double number;
+            if(!parse_number(parser, &number)) return 0;
+            parser->json->values[*index].number = number;
+            return 1;
+        }
+    }
+}
+
+int json_parse(json_t * json, const char * text, size_t length, allocator_t * a) {
+    memset(json, 0, sizeof(*json));
+    json->a = a;
+
+    json_parser_t parser = { json, text, text, text + length };
+    uint32_t root;
+    if(!parse_value(&parser, &root, 0)) return 0;
+    skip_space(&parser);
+    if(parser.p != parser.end) return fail(&parser, "trailing characters");
+    return 1;
+}
+
+void json_free(json_t * json) {
+    if(json->values) allocator_free_sized(json->a, json->values, json->capacity * sizeof(json_value_t));
+    json->values = NULL;
+    json->count = 0;
+    json->capacity = 0;
+}
+
+const json_value_t * json_root(const json_t * json) {
+    return json->count > 0 ? &json->values[0] : NULL;
+}
+
+const json_value_t * json_get(const json_t * json, const json_value_t * object, const char * key) {
+    if(!object || object->type != JSON_OBJECT) return NULL;
+    size_t length = strlen(key);
+    for(const json_value_t * member = json_first(json, object); member; member = json_next(json, member)) {
+        if(member->key_length == length && memcmp(member->key, key, length) == 0) return member;
+    }
+    return NULL;
+}
+
+const json_value_t * json_first(const json_t * json, const json_value_t * value) {
+    if(!value || value->first_child == JSON_NONE) return NULL;
+    return &json->values[value->first_child];
+}
+
+const json_value_t * json_next(const json_t * json, const json_value_t * value) {
+    if(!value || value->next == JSON_NONE) return NULL;
+    return &json->values[value->next];
+}
+
+double json_number(const json_value_t * value, double fallback) {
+    return value && value->type == JSON_NUMBER ? value->number : fallback;
+}
+
+int json_string_equals(const json_value_t * value, const char * string) {
+    if(!value || value->type != JSON_STRING || value->escaped) return 0;
+    size_t length = strlen(string);
+    return value->length == length && memcmp(value->string, string, length) == 0;
+}
+
+static int hex_digit(char c) {
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static unsigned int parse_hex4(const char * p, const char * end) {
+    if(end - p < 4) return 0xfffd;
+    unsigned int code = 0;
+    for(int i = 0; i < 4; i++) {
+        int digit = hex_digit(p[i]);
+        if(digit < 0) return 0xfffd;
+        code = code * 16 + digit;
+    }
+    return code;
+}
+
+size_t json_string_copy(const json_value_t * value, char * buffer, size_t size) {
+    size_t out = 0;
+    if(!value || value->type != JSON_STRING) {
+        if(size) buffer[0] = 0;
+        return 0;
+    }
+
+    const char * p = value->string;
+    const char * end = p + value->length;
+    while(p < end) {
+        char bytes[4];
+        int count = 1;
+        if(*p != '\\') {
+            bytes[0] = *p++;
+        } else {
+            p++;
+            char escape = p < end ? *p++ : 0;
+            switch(escape) {
+                case 'b': bytes[0] = '\b'; break;
+                case 'f': bytes[0] = '\f'; break;
+                case 'n': bytes[0] = '\n'; break;
+                case 'r': bytes[0] = '\r'; break;
+                case 't': bytes[0] = '\t'; break;
+                case 'u': {
+                    unsigned int code = parse_hex4(p, end);
+                    p += end - p < 4 ? end - p : 4;
+                    // A surrogate pair spells one code point past the basic plane
+                    if(code >= 0xd800 && code < 0xdc00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                        unsigned int low = parse_hex4(p + 2, end);
+                        if(low >= 0xdc00 && low < 0xe000) {
+                            code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                            p += 6;
+                        }
+                    }
+                    if(code < 0x80) {
+                        bytes[0] = (char)code;
+                    } else if(code < 0x800) {
+                        bytes[0] = (char)(0xc0 | code >> 6);
+                        bytes[1] = (char)(0x80 | (code & 0x3f));
+                        count = 2;
+                    } else if(code < 0x10000) {
+                        bytes[0] = (char)(0xe0 | code >> 12);
+                        bytes[1] = (char)(0x80 | ((code >> 6) & 0x3f));
+                        bytes[2] = (char)(0x80 | (code & 0x3f));
+                        count = 3;
+                    } else {
+                        bytes[0] = (char)(0xf0 | code >> 18);
+                        bytes[1] = (char)(0x80 | ((code >> 12) & 0x3f));
+                        bytes[2] = (char)(0x80 | ((code >> 6) & 0x3f));
+                        bytes[3] = (char)(0x80 | (code & 0x3f));
+                        count = 4;
+                    }
+                    break;
+                }
+                default: bytes[0] = escape; break; // '"', '\\' and '/'
+            }
+        }
+        for(int i = 0; i < count; i++, out++) {
+            if(out + 1 < size) buffer[out] = bytes[i];
+        }
+    }
+    if(size) buffer[out < size ? out : size - 1] = 0;
+    return out;
+}
@@ -5,10 +5,20 @@
 #include "allocator.h"
 #include "shader.h"
 #include "shape.h"
+#include "geometry_heap.h"
+#include "draw_commands.h"
+#include "pool.h"
+#include "async_io.h"
+#include "texture.h"
+#include "mipmap.h"
+#include "bc.h"
+#include "gl_state.h"
 #include "math.h"
 
 #define WINDOW_WIDTH 800
 #define WINDOW_HEIGHT 600
+#define TEXTURE_UPLOAD_BUDGET 0.002 // seconds per frame
+#define TEXTURE_CACHE_DIR "cache"
 
 void framebuffer_size_callback(GLFWwindow * window, int width, int height) {
     glViewport(0, 0, width, height);
@@ -20,27 +30,66 @@ void process_input(GLFWwindow * window) {
     }
 }
 
-void make_square(shape_t * square, float * vertices, size_t vertices_size, unsigned int * indices, size_t indices_size, shader_program_t * program, const char * vertex_path, const char * fragment_path, allocator_t * a) {
-    shape_init(square);
-    shape_load_vertices(square, vertices, vertices_size);
-    shape_load_indices(square, indices, indices_size);
-    shape_interpret_and_enable(square, 0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
+typedef struct program_load_t program_load_t;
 
-    shader_t vertex_shader = shader_compile(GL_VERTEX_SHADER, vertex_path, a);
-    shader_t fragment_shader = shader_compile(GL_FRAGMENT_SHADER, fragment_path, a);
-    *program = shader_program_link(vertex_shader, fragment_shader);
+// Both sources are read on the async io workers, each is compiled as soon as it arrives
+struct program_load_t {
+    shader_program_t * program;
+    allocator_t * a;
+    shader_t shaders[2];
+    int remaining;
+};
+
+void program_load_shader(program_load_t * load, int i, GLenum shader_type, const char * source) {
+    load->shaders[i] = shader_compile_source(shader_type, source);
+    if(--load->remaining == 0) *load->program = shader_program_link(load->shaders[0], load->shaders[1], load->a);
+}
+
+void vertex_source_loaded(async_io_request_t * request) {
+    program_load_shader(request->user, 0, GL_VERTEX_SHADER, request->data);
+}
+
+void fragment_source_loaded(async_io_request_t * request) {
+    program_load_shader(request->user, 1, GL_FRAGMENT_SHADER, request->data);
+}
+
+void load_program(program_load_t * load, shader_program_t * program, const char * vertex_path, const char * fragment_path, async_io_t * io, allocator_t * a) {
+    load->program = program;
+    load->a = a;
+    load->remaining = 2;
+    async_io_read(io, vertex_path, ASYNC_IO_PRIORITY_NORMAL, NULL, &vertex_source_loaded, load);
+    async_io_read(io, fragment_path, ASYNC_IO_PRIORITY_NORMAL, NULL, &fragment_source_loaded, load);
+}
+
+void make_square(shape_t * square, geometry_heap_set_t * heaps, float * vertices, size_t vertices_size, unsigned int * indices, size_t indices_size, shader_program_t * program, const char * vertex_path, const char * fragment_path, program_load_t * load, async_io_t * io, allocator_t * a) {
+    vertex_layout_t layout;
+    vertex_layout_init(&layout);
+    vertex_layout_add(&layout, 0, VERTEX_FORMAT_FLOAT3);
+
+    geometry_heap_t * heap = geometry_heap_set_get(heaps, &layout);
+    geometry_heap_add(heap, square, vertices, vertices_size / heap->stride, indices, indices_size / sizeof(unsigned int));
+
+    load_program(load, program, vertex_path, fragment_path, io, a);
 }
 
-void make_colourful_triangle(shape_t * square, float * vertices, size_t vertices_size, unsigned int * indices, size_t indices_size, shader_program_t * program, const char * vertex_path, const char * fragment_path, allocator_t * a) {
-    shape_init(square);
-    shape_load_vertices(square, vertices, vertices_size);
-    shape_load_indices(square, indices, indices_size);
-    shape_interpret_and_enable(square, 0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *)0);
-    shape_interpret_and_enable(square, 1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *)(3 * sizeof(float)));
+typedef struct colour_vertex_t colour_vertex_t;
 
-    shader_t vertex_shader = shader_compile(GL_VERTEX_SHADER, vertex_path, a);
-    shader_t fragment_shader = shader_compile(GL_FRAGMENT_SHADER, fragment_path, a);
-    *program = shader_program_link(vertex_shader, fragment_shader);
+// 16 bytes, the colour is normalised from bytes
+struct colour_vertex_t {
+    float position[3];
+    uint8_t colour[4];
+};
+
+void make_colourful_triangle(shape_t * square, geometry_heap_set_t * heaps, colour_vertex_t * vertices, size_t vertices_size, unsigned int * indices, size_t indices_size, shader_program_t * program, const char * vertex_path, const char * fragment_path, program_load_t * load, async_io_t * io, allocator_t * a) {
+    vertex_layout_t layout;
+    vertex_layout_init(&layout);
+    vertex_layout_add(&layout, 0, VERTEX_FORMAT_FLOAT3);
+    vertex_layout_add(&layout, 1, VERTEX_FORMAT_UNORM8X4);
+
+    geometry_heap_t * heap = geometry_heap_set_get(heaps, &layout);
+    geometry_heap_add(heap, square, vertices, vertices_size / heap->stride, indices, indices_size / sizeof(unsigned int));
+
+    load_program(load, program, vertex_path, fragment_path, io, a);
 }
 
 
@@ -66,6 +115,9 @@ int main() {
         return -1;
     }
 
+    // The 3.3 context draws the commands in a loop, later contexts submit them in one call
+    draw_commands_load((GLADloadproc)glfwGetProcAddress);
+
     glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
     glfwSetWindowSizeCallback(window, framebuffer_size_callback);
     // End of OpenGL setup
@@ -73,6 +125,16 @@ int main() {
     allocator_t a;
     allocator_new_heap_allocator(&a);
 
+    async_io_t io;
+    async_io_init(&io, 0, &a);
+
+    texture_loader_t textures;
+    texture_loader_init(&textures, &io, &a);
+    texture_loader_set_mipmaps(&textures, 1, MIPMAP_FILTER_BOX, 1);
+    if(!texture_loader_set_compression(&textures, BC_FORMAT_BC7, TEXTURE_CACHE_DIR)) {
+        texture_loader_set_compression(&textures, BC_FORMAT_BC3, TEXTURE_CACHE_DIR);
+    }
+
     float vertices[] = {
         0.5f, 0.5f, 0.0f, // top right
         0.5f, -0.5f, 0.0f, // bottom right
@@ -85,10 +147,10 @@ int main() {
         1, 2, 3
     };
 
-    float colour_vertices[] = {
-        0.5f, -0.5f, 0.0f, 1.0f, 0.0f, 0.0f,
-        -0.5f, -0.5f, 0.0f, 0.0f, 1.0f, 0.0f,
-        0.0f, 0.5f, 0.0f, 0.0f, 0.0f, 1.0f
+    colour_vertex_t colour_vertices[] = {
+        { { 0.5f, -0.5f, 0.0f }, { 255, 0, 0, 255 } },
+        { { -0.5f, -0.5f, 0.0f }, { 0, 255, 0, 255 } },
+        { { 0.0f, 0.5f, 0.0f }, { 0, 0, 255, 255 } }
     };
 
     unsigned int colour_indices[] = {
@@ -96,15 +158,31 @@ int main() {
     };
 
 
-    shape_t shape;
+    // One heap per vertex layout, all shapes of a layout draw from the same VAO
+    geometry_heap_set_t heaps;
+    geometry_heap_set_init(&heaps, 1024, 1024, &a);
+
+    pool_t shapes;
+    pool_init(&shapes, sizeof(shape_t), 16, &a);
+
+    draw_commands_t draws;
+    draw_commands_init(&draws, 16, &a);
+
+    pool_handle_t shape = pool_alloc(&shapes);
     shader_program_t program;
-    //make_square(&shape, vertices, sizeof(vertices), indices, sizeof(indices), &program, "shaders/simple_vertex.glsl", "shaders/simple_fragment.glsl", &a);
-    make_colourful_triangle(&shape, colour_vertices, sizeof(colour_vertices), colour_indices, sizeof(colour_indices), &program, "shaders/colourful_vertex.glsl", "shaders/colourful_fragment.glsl", &a);
+    program_load_t program_load;
+    //make_square(pool_get(&shapes, shape), &heaps, vertices, sizeof(vertices), indices, sizeof(indices), &program, "shaders/simple_vertex.glsl", "shaders/simple_fragment.glsl", &program_load, &io, &a);
+    make_colourful_triangle(pool_get(&shapes, shape), &heaps, colour_vertices, sizeof(colour_vertices), colour_indices, sizeof(colour_indices), &program, "shaders/colourful_vertex.glsl", "shaders/colourful_fragment.glsl", &program_load, &io, &a);
+    async_io_flush(&io);
 
     while(!glfwWindowShouldClose(window)) {
         // Process input
         process_input(window);
 
+        // Finish loads, uploads that do not fit in the budget wait for the next frame
+        async_io_poll(&io);
+        texture_loader_upload(&textures, TEXTURE_UPLOAD_BUDGET);
+
         // Render
         glClearColor(0.8f, 0.8f, 0.8f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
@@ -117,14 +195,38 @@ int main() {
         //glBindVertexArray(VAO);
         //glDrawArrays(GL_TRIANGLES, 0, 3);
         //glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-        shape_draw(&shape);
-        glBindVertexArray(0);
+        draw_commands_reset(&draws);
+        shape_t * live_shapes = pool_items(&shapes);
+        for(uint32_t i = 0; i < pool_count(&shapes); i++) {
+            draw_commands_add_shape(&draws, &live_shapes[i], 1, 0);
+        }
+        // Every shape so far shares the one layout of the triangle
+        if(pool_count(&shapes) > 0) draw_commands_submit(&draws, live_shapes[0].VAO, program, -1);
+        gl_state_end_frame();
+        texture_loader_end_frame(&textures);
 
         // Check and call events and swap buffers
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
+#ifdef DEBUG
+    gl_state_stats_t stats = gl_state_get_stats();
+    printf("Binds elided last frame: programs %u/%u, vertex arrays %u/%u, buffers %u/%u, textures %u/%u\n",
+        stats.programs.elided, stats.programs.issued + stats.programs.elided,
+        stats.vertex_arrays.elided, stats.vertex_arrays.issued + stats.vertex_arrays.elided,
+        stats.buffers.elided, stats.buffers.issued + stats.buffers.elided,
+        stats.textures.elided, stats.textures.issued + stats.textures.elided);
+    texture_upload_stats_t upload_stats = texture_loader_get_stats(&textures);
+    printf("Texture uploads last frame: %u, %zu bytes, %f s stalled, %u orphaned buffers\n", upload_stats.uploads, upload_stats.bytes, upload_stats.stall_seconds, upload_stats.orphans);
+#endif
+
+    async_io_deinit(&io);
+    texture_loader_deinit(&textures);
+    draw_commands_deinit(&draws);
+    geometry_heap_set_deinit(&heaps);
+    pool_deinit(&shapes);
+    shader_program_delete(program);
     glfwTerminate();
     return 0;
 }
@@ -0,0 +1,173 @@
+#include "mesh_file.h"
+#include "debug.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#define MESH_FILE_ALIGNMENT 16
+#define MESH_FILE_WRITE_CHUNK 4096
+
+typedef struct mesh_file_header_t mesh_file_header_t;
+typedef struct mesh_file_attribute_t mesh_file_attribute_t;
+
+struct mesh_file_header_t {
+    char magic[4];
+    uint32_t version;
+    uint32_t attribute_count;
+    uint32_t index_type;
+    uint32_t vertex_count;
+    uint32_t index_count;
+    uint32_t submesh_count;
+    uint32_t stride;
+    uint64_t submesh_offset;
+    uint64_t vertex_offset;
+    uint64_t index_offset;
+};
+
+struct mesh_file_attribute_t {
+    uint32_t location;
+    uint32_t format;
+};
+
+static size_t align(size_t offset) {
+    return (offset + MESH_FILE_ALIGNMENT - 1) & ~(size_t)(MESH_FILE_ALIGNMENT - 1);
+}
+
+// Whether size bytes at offset lie inside the file
+static int in_file(const mesh_file_t * mesh, uint64_t offset, uint64_t size) {
+    return offset <= mesh->mapping.size && size <= mesh->mapping.size - offset;
+}
+
+void mesh_file_load(mesh_file_t * mesh, const char * path, allocator_t * a) {
+    io_map_file(&mesh->mapping, path, IO_ACCESS_SEQUENTIAL, a);
+    const char * data = mesh->mapping.data;
+
+    mesh_file_header_t header;
+    if(mesh->mapping.size < sizeof(header)) panic("Mesh file %s is truncated\n", path);
+    memcpy(&header, data, sizeof(header));
+    if(memcmp(header.magic, "BMSH", 4) != 0) panic("%s is not a mesh file\n", path);
+    if(header.version != MESH_FILE_VERSION) panic("Mesh file %s is version %u, expected %u\n", path, header.version, MESH_FILE_VERSION);
+    if(header.attribute_count > VERTEX_LAYOUT_MAX_ATTRIBUTES) panic("Mesh file %s has %u attributes\n", path, header.attribute_count);
+    if(header.index_type != GL_UNSIGNED_SHORT && header.index_type != GL_UNSIGNED_INT) panic("Mesh file %s has unknown index type 0x%x\n", path, header.index_type);
+
+    vertex_layout_init(&mesh->layout);
+    if(!in_file(mesh, sizeof(header), header.attribute_count * sizeof(mesh_file_attribute_t))) panic("Mesh file %s is truncated\n", path);
+    for(uint32_t i = 0; i < header.attribute_count; i++) {
+        mesh_file_attribute_t attribute;
+        memcpy(&attribute, data + sizeof(header) + i * sizeof(attribute), sizeof(attribute));
+        if(attribute.format >= VERTEX_FORMAT_COUNT) panic("Mesh file %s has unknown vertex format %u\n", path, attribute.format);
+        vertex_layout_add(&mesh->layout, attribute.location, (vertex_format_t)attribute.format);
+    }
+    if(mesh->layout.stride != header.stride) panic("Mesh file %s has a stride of %u, its layout one of %zu\n", path, header.stride, mesh->layout.stride);
+
+    mesh->index_type = header.index_type;
+    mesh->vertex_count = header.vertex_count;
+    mesh->vertices_size = (size_t)header.vertex_count * header.stride;
+    mesh->index_count = header.index_count;
+    mesh->indices_size = (size_t)header.index_count * (header.index_type == GL_UNSIGNED_SHORT ? 2 : 4);
+    mesh->submesh_count = header.submesh_count;
+
+    if(!in_file(mesh, header.submesh_offset, header.submesh_count * sizeof(mesh_file_submesh_t))
+        || !in_file(mesh, header.vertex_offset, mesh->vertices_size)
+        || !in_file(mesh, header.index_offset, mesh->indices_size)) {
+        panic("Mesh file %s is truncated\n", path);
+    }
+    if(header.submesh_offset % MESH_FILE_ALIGNMENT || header.vertex_offset % MESH_FILE_ALIGNMENT || header.index_offset % MESH_FILE_ALIGNMENT) {
+        panic("Mesh file %s has misaligned blobs\n", path);
+    }
+    mesh->submeshes = (const mesh_file_submesh_t *)(data + header.submesh_offset);
+    mesh->vertices = data + header.vertex_offset;
+    mesh->indices = data + header.index_offset;
+
+    for(size_t i = 0; i < mesh->submesh_count; i++) {
+        const mesh_file_submesh_t * submesh = &mesh->submeshes[i];
+        if(submesh->first_index > mesh->index_count || submesh->index_count > mesh->index_count - submesh->first_index) {
+            panic("Submesh %zu of mesh file %s is outside its indices\n", i, path);
+        }
+    }
+}
+
+void mesh_file_unload(mesh_file_t * mesh) {
+    io_unmap_file(&mesh->mapping);
+    mesh->vertices = NULL;
+    mesh->indices = NULL;
+    mesh->submeshes = NULL;
+}
+
+void mesh_file_create_shape(mesh_file_t * mesh, shape_t * shape) {
+    shape_init(shape);
+    shape_load_vertices(shape, mesh->vertices, mesh->vertices_size);
+    shape_load_indices_typed(shape, mesh->indices, mesh->indices_size, mesh->index_type);
+    shape_set_layout(shape, &mesh->layout);
+}
+
+void mesh_file_submesh_shape(mesh_file_t * mesh, shape_t * shape, size_t i, shape_t * submesh) {
+    *submesh = *shape;
+    submesh->first_index = mesh->submeshes[i].first_index;
+    submesh->element_count = mesh->submeshes[i].index_count;
+    submesh->base_vertex = shape->base_vertex + mesh->submeshes[i].base_vertex;
+}
+
+static int write_padding(FILE * f, size_t * offset) {
+    static const char zeros[MESH_FILE_ALIGNMENT] = { 0 };
+    size_t padding = align(*offset) - *offset;
+    *offset += padding;
+    return fwrite(zeros, 1, padding, f) == padding;
+}
+
+int mesh_file_write(const char * path, const vertex_layout_t * layout, const void * vertices, size_t vertex_count, const unsigned int * indices, size_t index_count, const mesh_file_submesh_t * submeshes, size_t submesh_count) {
+    unsigned int max_index = 0;
+    for(size_t i = 0; i < index_count; i++) {
+        if(indices[i] > max_index) max_index = indices[i];
+    }
+    int short_indices = max_index <= UINT16_MAX;
+
+    mesh_file_submesh_t whole = { 0, (uint32_t)index_count, 0, 0 };
+    if(submesh_count == 0) {
+        submeshes = &whole;
+        submesh_count = 1;
+    }
+
+    mesh_file_header_t header = { { 'B', 'M', 'S', 'H' }, MESH_FILE_VERSION, layout->attribute_count, short_indices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT,
+        (uint32_t)vertex_count, (uint32_t)index_count, (uint32_t)submesh_count, (uint32_t)layout->stride, 0, 0, 0 };
+    size_t offset = sizeof(header) + layout->attribute_count * sizeof(mesh_file_attribute_t);
+    header.submesh_offset = align(offset);
+    header.vertex_offset = align(header.submesh_offset + submesh_count * sizeof(mesh_file_submesh_t));
+    header.index_offset = align(header.vertex_offset + vertex_count * layout->stride);
+
+    // Written under a temporary name and renamed, so a failed write never leaves half a mesh behind
+    char temporary[1024];
+    snprintf(temporary, sizeof(temporary), "%s.%ld.tmp", path, (long)getpid());
+    FILE * f = fopen(temporary, "wb");
+    if(!f) return 0;
+
+    int ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    for(unsigned int i = 0; i < layout->attribute_count && ok; i++) {
+        mesh_file_attribute_t attribute = { layout->attributes[i].location, (uint32_t)layout->attributes[i].format };
+        ok = fwrite(&attribute, sizeof(attribute), 1, f) == 1;
+    }
+    ok = ok && write_padding(f, &offset);
+    ok = ok && fwrite(submeshes, sizeof(mesh_file_submesh_t), submesh_count, f) == submesh_count;
+    offset += submesh_count * sizeof(mesh_file_submesh_t);
+    ok = ok && write_padding(f, &offset);
+    ok = ok && fwrite(vertices, layout->stride, vertex_count, f) == vertex_count;
+    offset += vertex_count * layout->stride;
+    ok = ok && write_padding(f, &offset);
+
+    if(short_indices) {
+        uint16_t converted[MESH_FILE_WRITE_CHUNK];
+        for(size_t first = 0; first < index_count && ok; first += MESH_FILE_WRITE_CHUNK) {
+            size_t n = index_count - first < MESH_FILE_WRITE_CHUNK ? index_count - first : MESH_FILE_WRITE_CHUNK;
+            for(size_t i = 0; i < n; i++) converted[i] = (uint16_t)indices[first + i];
+            ok = fwrite(converted, sizeof(uint16_t), n, f) == n;
+        }
+    } else {
+        ok = ok && fwrite(indices, sizeof(unsigned int), index_count, f) == index_count;
+    }
+
+    if(fclose(f) != 0) ok = 0;
+    if(ok && rename(temporary, path) != 0) ok = 0;
+    if(!ok) remove(temporary);
+    return ok;
+}
@@ -0,0 +1,329 @@
+#include "mesh_optimizer.h"
+#include "debug.h"
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+typedef struct adjacency_t adjacency_t;
+
+// Triangles using each vertex, those of vertex v are triangles[offsets[v]] up to offsets[v + 1]
+struct adjacency_t {
+    unsigned int * offsets;
+    unsigned int * triangles;
+};
+
+static void * scratch(allocator_t * a, size_t size) {
+    void * memory = allocator_alloc(a, size > 0 ? size : 1);
+    if(!memory) panic("Failed to allocate %zu bytes of mesh optimizer scratch\n", size);
+    return memory;
+}
+
+static void adjacency_build(adjacency_t * adjacency, const unsigned int * indices, size_t index_count, size_t vertex_count, allocator_t * a) {
+    adjacency->offsets = scratch(a, (vertex_count + 1) * sizeof(unsigned int));
+    adjacency->triangles = scratch(a, index_count * sizeof(unsigned int));
+    memset(adjacency->offsets, 0, (vertex_count + 1) * sizeof(unsigned int));
+
+    for(size_t i = 0; i < index_count; i++) adjacency->offsets[indices[i] + 1]++;
+    for(size_t v = 0; v < vertex_count; v++) adjacency->offsets[v + 1] += adjacency->offsets[v];
+
+    unsigned int * fill = scratch(a, vertex_count * sizeof(unsigned int));
+    memcpy(fill, adjacency->offsets, vertex_count * sizeof(unsigned int));
+    for(size_t i = 0; i < index_count; i++) adjacency->triangles[fill[indices[i]]++] = (unsigned int)(i / 3);
+    allocator_free_sized(a, fill, vertex_count * sizeof(unsigned int));
+}
+
+static void adjacency_free(adjacency_t * adjacency, size_t index_count, size_t vertex_count, allocator_t * a) {
+    allocator_free_sized(a, adjacency->offsets, (vertex_count + 1) * sizeof(unsigned int));
+    allocator_free_sized(a, adjacency->triangles, index_count * sizeof(unsigned int));
+}
+
+static void check_indices(const unsigned int * indices, size_t index_count, size_t vertex_count) {
+    if(index_count % 3 != 0) panic("Mesh has %zu indices, not a multiple of 3\n", index_count);
+    for(size_t i = 0; i < index_count; i++) {
+        if(indices[i] >= vertex_count) panic("Mesh index %u out of %zu vertices\n", indices[i], vertex_count);
+    }
+}
+
+// The candidate still in the cache after the triangles it fans out, the one entered longest ago wins
+static long next_vertex(const unsigned int * candidates, size_t candidate_count, const unsigned int * live, const unsigned int * timestamps, unsigned int time, unsigned int cache_size, unsigned int * dead_ends, size_t * dead_end_count, unsigned int * cursor, size_t vertex_count) {
+    long best = -1;
+    long best_priority = -1;
+    for(size_t i = 0; i < candidate_count; i++) {
+        unsigned int v = candidates[i];
+        if(live[v] == 0) continue;
+
+        long priority = 0;
+        if(time - timestamps[v] + 2 * live[v] <= cache_size) priority = time - timestamps[v];
+        if(priority > best_priority) {
+            best = v;
+            best_priority = priority;
+        }
+    }
+    if(best >= 0) return best;
+
+    // Dead end, go back to a recent vertex that still has triangles, else the next one in order
+    while(*dead_end_count > 0) {
+        unsigned int v = dead_ends[--*dead_end_count];
+        if(live[v] > 0) return v;
+    }
+    while(*cursor < vertex_count) {
+        unsigned int v = (*cursor)++;
+        if(live[v] > 0) return v;
+    }
+    return -1;
+}
+
+void mesh_optimize_vertex_cache(unsigned int * destination, const unsigned int * indices, size_t index_count, size_t vertex_count, unsigned int cache_size, allocator_t * a) {
+    check_indices(indices, index_count, vertex_count);
+    if(index_count == 0) return;
+
+    // Reads from a copy so destination may be indices
+    unsigned int * source = scratch(a, index_count * sizeof(unsigned int));
+    memcpy(source, indices, index_count * sizeof(unsigned int));
+
+    adjacency_t adjacency;
+    adjacency_build(&adjacency, source, index_count, vertex_count, a);
+
+    size_t triangle_count = index_count / 3;
+    unsigned int * live = scratch(a, vertex_count * sizeof(unsigned int));
+    unsigned int * timestamps = scratch(a, vertex_count * sizeof(unsigned int));
+    unsigned char * emitted = scratch(a, triangle_count);
+    unsigned int * dead_ends = scratch(a, index_count * sizeof(unsigned int));
+    unsigned int * candidates = scratch(a, index_count * sizeof(unsigned int));
+    for(size_t v = 0; v < vertex_count; v++) {
+        live[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+        timestamps[v] = 0;
+    }
+    memset(emitted, 0, triangle_count);
+
+    size_t dead_end_count = 0;
+    size_t output = 0;
+    unsigned int time = cache_size + 1;
+    unsigned int cursor = 0;
+    long fanning = next_vertex(NULL, 0, live, timestamps, time, cache_size, dead_ends, &dead_end_count, &cursor, vertex_count);
+
+    while(fanning >= 0) {
+        size_t candidate_count = 0;
+        for(unsigned int i = adjacency.offsets[fanning]; i < adjacency.offsets[fanning + 1]; i++) {
+            unsigned int triangle = adjacency.triangles[i];
+            if(emitted[triangle]) continue;
+            emitted[triangle] = 1;
+
+            for(int corner = 0; corner < 3; corner++) {
+                unsigned int v = source[triangle * 3 + corner];
+                destination[output++] = v;
+                dead_ends[dead_end_count++] = v;
+                candidates[candidate_count++] = v;
+                live[v]--;
+                if(time - timestamps[v] > cache_size) timestamps[v] = time++;
+            }
+        }
+        fanning = next_vertex(candidates, candidate_count, live, timestamps, time, cache_size, dead_ends, &dead_end_count, &cursor, vertex_count);
+    }
+
+    allocator_free_sized(a, candidates, index_count * sizeof(unsigned int));
+    allocator_free_sized(a, dead_ends, index_count * sizeof(unsigned int));
+    allocator_free_sized(a, emitted, triangle_count);
+    allocator_free_sized(a, timestamps, vertex_count * sizeof(unsigned int));
+    allocator_free_sized(a, live, vertex_count * sizeof(unsigned int));
+    adjacency_free(&adjacency, index_count, vertex_count, a);
+    allocator_free_sized(a, source, index_count * sizeof(unsigned int));
+}
+
+// Misses of one triangle in a FIFO cache kept as insertion times, the cache holds what entered after time - cache_size
+static unsigned int triangle_misses(const unsigned int * triangle, unsigned int * timestamps, unsigned int * time, unsigned int cache_size) {
+    unsigned int misses = 0;
+    for(int corner = 0; corner < 3; corner++) {
+        unsigned int v = triangle[corner];
+        if(*time - timestamps[v] > cache_size) {
+            timestamps[v] = (*time)++;
+            misses++;
+        }
+    }
+    return misses;
+}
+
+static void reset_cache(unsigned int * timestamps, size_t vertex_count, unsigned int * time, unsigned int cache_size) {
+    memset(timestamps, 0, vertex_count * sizeof(unsigned int));
+    *time = cache_size + 1;
+}
+
+mesh_cache_stats_t mesh_analyze_vertex_cache(const unsigned int * indices, size_t index_count, size_t vertex_count, unsigned int cache_size, allocator_t * a) {
+    mesh_cache_stats_t stats = { 0, 0.0f, 0.0f };
+    check_indices(indices, index_count, vertex_count);
+    if(index_count == 0) return stats;
+
+    unsigned int * timestamps = scratch(a, vertex_count * sizeof(unsigned int));
+    unsigned char * referenced = scratch(a, vertex_count);
+    unsigned int time;
+    reset_cache(timestamps, vertex_count, &time, cache_size);
+    memset(referenced, 0, vertex_count);
+
+    size_t unique = 0;
+    for(size_t i = 0; i < index_count; i += 3) {
+        stats.transformed += triangle_misses(&indices[i], timestamps, &time, cache_size);
+        for(int corner = 0; corner < 3; corner++) {
+            if(!referenced[indices[i + corner]]) unique++;
+            referenced[indices[i + corner]] = 1;
+        }
+    }
+    stats.acmr = (float)stats.transformed / (index_count / 3);
+    stats.atvr = (float)stats.transformed / unique;
+
+    allocator_free_sized(a, referenced, vertex_count);
+    allocator_free_sized(a, timestamps, vertex_count * sizeof(unsigned int));
+    return stats;
+}
+
+typedef struct cluster_t {
+    size_t first; // triangle
+    size_t count;
+    float sort_key;
+} cluster_t;
+
+static int compare_clusters(const void * left, const void * right) {
+    const cluster_t * l = left;
+    const cluster_t * r = right;
+    if(l->sort_key != r->sort_key) return l->sort_key > r->sort_key ? -1 : 1;
+    return l->first < r->first ? -1 : (l->first > r->first);
+}
+
+static const float * position(const float * positions, size_t position_stride, unsigned int v) {
+    return (const float *)((const unsigned char *)positions + v * position_stride);
+}
+
+// Returns twice the area, normal is unnormalised with that length
+static double triangle_geometry(const unsigned int * triangle, const float * positions, size_t position_stride, double normal[3], double centre[3]) {
+    const float * p0 = position(positions, position_stride, triangle[0]);
+    const float * p1 = position(positions, position_stride, triangle[1]);
+    const float * p2 = position(positions, position_stride, triangle[2]);
+    double e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+    double e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+    normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+    for(int k = 0; k < 3; k++) centre[k] = (p0[k] + p1[k] + p2[k]) / 3.0;
+    return sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+}
+
+void mesh_optimize_overdraw(unsigned int * destination, const unsigned int * indices, size_t index_count, const float * positions, size_t position_stride, size_t vertex_count, unsigned int cache_size, float threshold, allocator_t * a) {
+    check_indices(indices, index_count, vertex_count);
+    if(index_count == 0) return;
+
+    size_t triangle_count = index_count / 3;
+    unsigned int * source = scratch(a, index_count * sizeof(unsigned int));
+    memcpy(source, indices, index_count * sizeof(unsigned int));
+    unsigned int * timestamps = scratch(a, vertex_count * sizeof(unsigned int));
+    unsigned char * starts = scratch(a, triangle_count);
+    memset(starts, 0, triangle_count);
+    unsigned int time;
+
+    // Hard boundaries, where the cache missed every vertex the ordering restarted somewhere else
+    reset_cache(timestamps, vertex_count, &time, cache_size);
+    for(size_t t = 0; t < triangle_count; t++) {
+        if(triangle_misses(&source[t * 3], timestamps, &time, cache_size) == 3) starts[t] = 1;
+    }
+    starts[0] = 1;
+
+    // Soft boundaries inside them, where splitting costs little cache efficiency
+    for(size_t first = 0; first < triangle_count;) {
+        size_t end = first + 1;
+        while(end < triangle_count && !starts[end]) end++;
+
+        unsigned int misses = 0;
+        reset_cache(timestamps, vertex_count, &time, cache_size);
+        for(size_t t = first; t < end; t++) misses += triangle_misses(&source[t * 3], timestamps, &time, cache_size);
+        float limit = threshold * misses / (end - first);
+
+        reset_cache(timestamps, vertex_count, &time, cache_size);
+        size_t piece = first;
+        misses = 0;
+        for(size_t t = first; t < end; t++) {
+            misses += triangle_misses(&source[t * 3], timestamps, &time, cache_size);
+            if(t + 1 < end && (float)misses / (t + 1 - piece) <= limit) {
+                starts[t + 1] = 1;
+                piece = t + 1;
+                misses = 0;
+                reset_cache(timestamps, vertex_count, &time, cache_size);
+            }
+        }
+        first = end;
+    }
+
+    size_t cluster_count = 0;
+    for(size_t t = 0; t < triangle_count; t++) cluster_count += starts[t];
+    cluster_t * clusters = scratch(a, cluster_count * sizeof(cluster_t));
+    for(size_t t = 0, c = 0; t < triangle_count; t++) {
+        if(starts[t]) {
+            clusters[c].first = t;
+            clusters[c].count = 0;
+            c++;
+        }
+        clusters[c - 1].count++;
+    }
+
+    // Area weighted centre of the mesh, then of each cluster with its summed normal
+    double mesh_centre[3] = { 0.0, 0.0, 0.0 };
+    double mesh_area = 0.0;
+    for(size_t t = 0; t < triangle_count; t++) {
+        double triangle_normal[3], triangle_centre[3];
+        double area = triangle_geometry(&source[t * 3], positions, position_stride, triangle_normal, triangle_centre);
+        for(int k = 0; k < 3; k++) mesh_centre[k] += area * triangle_centre[k];
+        mesh_area += area;
+    }
+    for(int k = 0; k < 3; k++) mesh_centre[k] = mesh_area > 0.0 ? mesh_centre[k] / mesh_area : 0.0;
+
+    for(size_t c = 0; c < cluster_count; c++) {
+        double centre[3] = { 0.0, 0.0, 0.0 };
+        double normal[3] = { 0.0, 0.0, 0.0 };
+        double area_sum = 0.0;
+        for(size_t t = clusters[c].first; t < clusters[c].first + clusters[c].count; t++) {
+            double triangle_normal[3], triangle_centre[3];
+            double area = triangle_geometry(&source[t * 3], positions, position_stride, triangle_normal, triangle_centre);
+            for(int k = 0; k < 3; k++) {
+                centre[k] += area * triangle_centre[k];
+                normal[k] += triangle_normal[k];
+            }
+            area_sum += area;
+        }
+        double length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        float key = 0.0f;
+        if(area_sum > 0.0 && length > 0.0) {
+            for(int k = 0; k < 3; k++) key += (float)((centre[k] / area_sum - mesh_centre[k]) * normal[k] / length);
+        }
+        clusters[c].sort_key = key;
+    }
+
+    qsort(clusters, cluster_count, sizeof(cluster_t), compare_clusters);
+
+    size_t output = 0;
+    for(size_t c = 0; c < cluster_count; c++) {
+        memcpy(&destination[output], &source[clusters[c].first * 3], clusters[c].count * 3 * sizeof(unsigned int));
+        output += clusters[c].count * 3;
+    }
+
+    allocator_free_sized(a, clusters, cluster_count * sizeof(cluster_t));
+    allocator_free_sized(a, starts, triangle_count);
+    allocator_free_sized(a, timestamps, vertex_count * sizeof(unsigned int));
+    allocator_free_sized(a, source, index_count * sizeof(unsigned int));
+}
+
+size_t mesh_optimize_vertex_fetch(void * destination, unsigned int * indices, size_t index_count, const void * vertices, size_t vertex_count, size_t vertex_size, allocator_t * a) {
+    check_indices(indices, index_count, vertex_count);
+
+    unsigned int * remap = scratch(a, vertex_count * sizeof(unsigned int));
+    memset(remap, 0xff, vertex_count * sizeof(unsigned int));
+
+    size_t next = 0;
+    for(size_t i = 0; i < index_count; i++) {
+        unsigned int v = indices[i];
+        if(remap[v] == (unsigned int)-1) {
+            memcpy((unsigned char *)destination + next * vertex_size, (const unsigned char *)vertices + v * vertex_size, vertex_size);
+            remap[v] = (unsigned int)next++;
+        }
+        indices[i] = remap[v];
+    }
+
+    allocator_free_sized(a, remap, vertex_count * sizeof(unsigned int));
+    return next;
+}
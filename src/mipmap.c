@@ -0,0 +1,270 @@
+#include "mipmap.h"
+#include "debug.h"
+#include <math.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MIPMAP_X86
+#endif
+
+#define LINEAR_TO_SRGB_SIZE 8192
+#define KAISER_TAPS 12
+#define KAISER_WIDTH 3.0
+#define KAISER_ALPHA 4.0
+#define RING_ROWS 16
+
+static float srgb_to_linear[256];
+static unsigned char linear_to_srgb[LINEAR_TO_SRGB_SIZE];
+static float kaiser_weights[KAISER_TAPS];
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+static double bessel_i0(double x) {
+    double sum = 1.0, term = 1.0;
+    for(int k = 1; k < 32; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+static void build_tables(void) {
+    for(int i = 0; i < 256; i++) {
+        double c = i / 255.0;
+        srgb_to_linear[i] = (float)(c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4));
+    }
+    for(int i = 0; i < LINEAR_TO_SRGB_SIZE; i++) {
+        double l = i / (double)(LINEAR_TO_SRGB_SIZE - 1);
+        double c = l <= 0.0031308 ? l * 12.92 : 1.055 * pow(l, 1.0 / 2.4) - 0.055;
+        linear_to_srgb[i] = (unsigned char)(c * 255.0 + 0.5);
+    }
+
+    // Output pixel x is centred on source position 2x + 1, tap k reads source pixel 2x - 5 + k
+    double sum = 0.0;
+    double weights[KAISER_TAPS];
+    for(int k = 0; k < KAISER_TAPS; k++) {
+        double t = ((k - 5) + 0.5 - 1.0) / 2.0; // distance in output pixels
+        double sinc = t == 0.0 ? 1.0 : sin(M_PI * t) / (M_PI * t);
+        double x = t / KAISER_WIDTH;
+        double window = fabs(x) < 1.0 ? bessel_i0(KAISER_ALPHA * sqrt(1.0 - x * x)) / bessel_i0(KAISER_ALPHA) : 0.0;
+        weights[k] = sinc * window;
+        sum += weights[k];
+    }
+    for(int k = 0; k < KAISER_TAPS; k++) kaiser_weights[k] = (float)(weights[k] / sum);
+}
+
+static inline int clamp_int(int v, int lo, int hi) {
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+static inline unsigned char encode(float v, int srgb) {
+    if(v <= 0.0f) return 0;
+    if(v >= 1.0f) return 255;
+    if(srgb) return linear_to_srgb[(int)(v * (LINEAR_TO_SRGB_SIZE - 1) + 0.5f)];
+    return (unsigned char)(v * 255.0f + 0.5f);
+}
+
+static void decode_row(const unsigned char * src, int width, int srgb, float * out) {
+    for(int i = 0; i < width * 4; i += 4) {
+        for(int c = 0; c < 3; c++) out[i + c] = srgb ? srgb_to_linear[src[i + c]] : src[i + c] * (1.0f / 255.0f);
+        out[i + 3] = src[i + 3] * (1.0f / 255.0f);
+    }
+}
+
+static void encode_row(const float * in, int width, int srgb, unsigned char * dst) {
+    for(int i = 0; i < width * 4; i += 4) {
+        for(int c = 0; c < 3; c++) dst[i + c] = encode(in[i + c], srgb);
+        dst[i + 3] = encode(in[i + 3], 0);
+    }
+}
+
+// Box filter on the raw bytes, (a + b + c + d + 2) / 4 per channel in every path
+
+static void box_row_scalar(const unsigned char * r0, const unsigned char * r1, int sw, unsigned char * dst, int x, int dw) {
+    for(; x < dw; x++) {
+        int x0 = 2 * x * 4;
+        int x1 = clamp_int(2 * x + 1, 0, sw - 1) * 4;
+        for(int c = 0; c < 4; c++) {
+            dst[x * 4 + c] = (unsigned char)((r0[x0 + c] + r0[x1 + c] + r1[x0 + c] + r1[x1 + c] + 2) >> 2);
+        }
+    }
+}
+
+#ifdef MIPMAP_X86
+static int box_row_sse2(const unsigned char * r0, const unsigned char * r1, int sw, unsigned char * dst, int dw) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i two = _mm_set1_epi16(2);
+    int x = 0;
+    // 2 output pixels from 4 source pixels of each row
+    for(; x + 2 <= dw && 2 * x + 4 <= sw; x += 2) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(r0 + 2 * x * 4));
+        __m128i b = _mm_loadu_si128((const __m128i *)(r1 + 2 * x * 4));
+        __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+        __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+        __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+        sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+        _mm_storel_epi64((__m128i *)(dst + x * 4), _mm_packus_epi16(sum, sum));
+    }
+    return x;
+}
+
+__attribute__((target("avx2")))
+static int box_row_avx2(const unsigned char * r0, const unsigned char * r1, int sw, unsigned char * dst, int dw) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i two = _mm256_set1_epi16(2);
+    int x = 0;
+    // 4 output pixels from 8 source pixels of each row, unpacking works per 128 bit lane
+    for(; x + 4 <= dw && 2 * x + 8 <= sw; x += 4) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(r0 + 2 * x * 4));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(r1 + 2 * x * 4));
+        __m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero));
+        __m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero));
+        __m256i sum = _mm256_add_epi16(_mm256_unpacklo_epi64(lo, hi), _mm256_unpackhi_epi64(lo, hi));
+        sum = _mm256_srli_epi16(_mm256_add_epi16(sum, two), 2);
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(sum, sum), 0x08);
+        _mm_storeu_si128((__m128i *)(dst + x * 4), _mm256_castsi256_si128(packed));
+    }
+    return x;
+}
+#endif
+
+static void box_linear(const texture_image_t * src, texture_image_t * dst) {
+#ifdef MIPMAP_X86
+    int avx2 = __builtin_cpu_supports("avx2");
+#endif
+    for(int y = 0; y < dst->height; y++) {
+        const unsigned char * r0 = src->pixels + (size_t)(2 * y) * src->width * 4;
+        const unsigned char * r1 = src->pixels + (size_t)clamp_int(2 * y + 1, 0, src->height - 1) * src->width * 4;
+        unsigned char * out = dst->pixels + (size_t)y * dst->width * 4;
+        int x = 0;
+#ifdef MIPMAP_X86
+        x = avx2 ? box_row_avx2(r0, r1, src->width, out, dst->width) : box_row_sse2(r0, r1, src->width, out, dst->width);
+#endif
+        box_row_scalar(r0, r1, src->width, out, x, dst->width);
+    }
+}
+
+// The float paths add in the same order with and without SSE, so they give identical results
+
+static inline void average4(const float * a, const float * b, const float * c, const float * d, float * out) {
+#ifdef MIPMAP_X86
+    __m128 ab = _mm_add_ps(_mm_loadu_ps(a), _mm_loadu_ps(b));
+    __m128 cd = _mm_add_ps(_mm_loadu_ps(c), _mm_loadu_ps(d));
+    _mm_storeu_ps(out, _mm_mul_ps(_mm_add_ps(ab, cd), _mm_set1_ps(0.25f)));
+#else
+    for(int i = 0; i < 4; i++) out[i] = ((a[i] + b[i]) + (c[i] + d[i])) * 0.25f;
+#endif
+}
+
+static void box_srgb(const texture_image_t * src, texture_image_t * dst, float * rows) {
+    float * f0 = rows;
+    float * f1 = rows + (size_t)src->width * 4;
+    float * out = f1 + (size_t)src->width * 4;
+
+    for(int y = 0; y < dst->height; y++) {
+        decode_row(src->pixels + (size_t)(2 * y) * src->width * 4, src->width, 1, f0);
+        decode_row(src->pixels + (size_t)clamp_int(2 * y + 1, 0, src->height - 1) * src->width * 4, src->width, 1, f1);
+        for(int x = 0; x < dst->width; x++) {
+            int x0 = 2 * x * 4;
+            int x1 = clamp_int(2 * x + 1, 0, src->width - 1) * 4;
+            average4(f0 + x0, f0 + x1, f1 + x0, f1 + x1, out + x * 4);
+        }
+        encode_row(out, dst->width, 1, dst->pixels + (size_t)y * dst->width * 4);
+    }
+}
+
+static inline void accumulate(float * acc, const float * px, float w) {
+#ifdef MIPMAP_X86
+    _mm_storeu_ps(acc, _mm_add_ps(_mm_loadu_ps(acc), _mm_mul_ps(_mm_loadu_ps(px), _mm_set1_ps(w))));
+#else
+    for(int i = 0; i < 4; i++) acc[i] = acc[i] + px[i] * w;
+#endif
+}
+
+// Horizontal pass of source row y into a ring of filtered rows, reused by the vertical taps
+static float * kaiser_row(const texture_image_t * src, int y, int srgb, float * decoded, float * ring, int * ring_rows, int dw) {
+    float * row = ring + (size_t)(y % RING_ROWS) * dw * 4;
+    if(ring_rows[y % RING_ROWS] == y) return row;
+    ring_rows[y % RING_ROWS] = y;
+
+    decode_row(src->pixels + (size_t)y * src->width * 4, src->width, srgb, decoded);
+    for(int x = 0; x < dw; x++) {
+        float * acc = row + x * 4;
+        acc[0] = acc[1] = acc[2] = acc[3] = 0.0f;
+        for(int k = 0; k < KAISER_TAPS; k++) {
+            int sx = clamp_int(2 * x - 5 + k, 0, src->width - 1);
+            accumulate(acc, decoded + sx * 4, kaiser_weights[k]);
+        }
+    }
+    return row;
+}
+
+static void kaiser(const texture_image_t * src, texture_image_t * dst, int srgb, float * scratch) {
+    float * decoded = scratch;
+    float * out = decoded + (size_t)src->width * 4;
+    float * ring = out + (size_t)dst->width * 4;
+    int ring_rows[RING_ROWS];
+    for(int i = 0; i < RING_ROWS; i++) ring_rows[i] = -1;
+
+    for(int y = 0; y < dst->height; y++) {
+        memset(out, 0, (size_t)dst->width * 4 * sizeof(float));
+        for(int k = 0; k < KAISER_TAPS; k++) {
+            int sy = clamp_int(2 * y - 5 + k, 0, src->height - 1);
+            float * row = kaiser_row(src, sy, srgb, decoded, ring, ring_rows, dst->width);
+            for(int x = 0; x < dst->width; x++) accumulate(out + x * 4, row + x * 4, kaiser_weights[k]);
+        }
+        encode_row(out, dst->width, srgb, dst->pixels + (size_t)y * dst->width * 4);
+    }
+}
+
+int mipmap_level_count(int width, int height) {
+    int levels = 1;
+    while((width > 1 || height > 1) && levels < MIPMAP_MAX_LEVELS) {
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+        levels++;
+    }
+    return levels;
+}
+
+void mipmap_generate(mipmap_chain_t * chain, texture_image_t * image, mipmap_filter_t filter, int srgb, allocator_t * a) {
+    pthread_once(&tables_once, &build_tables);
+
+    chain->a = a;
+    chain->level_count = mipmap_level_count(image->width, image->height);
+    chain->levels[0] = *image;
+
+    // Enough floats for every filter at the largest level: the box needs 3 rows of the source,
+    // Kaiser a decoded source row, an output row and the ring of filtered rows
+    size_t scratch_floats = (size_t)image->width * 4 * (3 + RING_ROWS);
+    float * scratch = NULL;
+    if(filter == MIPMAP_FILTER_KAISER || srgb) {
+        scratch = allocator_alloc(a, scratch_floats * sizeof(float));
+        if(!scratch) panic("Failed to allocate mipmap scratch memory\n");
+    }
+
+    for(int level = 1; level < chain->level_count; level++) {
+        texture_image_t * src = &chain->levels[level - 1];
+        texture_image_t * dst = &chain->levels[level];
+        dst->width = src->width > 1 ? src->width / 2 : 1;
+        dst->height = src->height > 1 ? src->height / 2 : 1;
+        dst->pixels = allocator_alloc(a, (size_t)dst->width * dst->height * 4);
+        if(!dst->pixels) panic("Failed to allocate mipmap level %d\n", level);
+
+        if(filter == MIPMAP_FILTER_KAISER) kaiser(src, dst, srgb, scratch);
+        else if(srgb) box_srgb(src, dst, scratch);
+        else box_linear(src, dst);
+    }
+
+    if(scratch) allocator_free_sized(a, scratch, scratch_floats * sizeof(float));
+}
+
+void mipmap_free(mipmap_chain_t * chain) {
+    for(int level = 1; level < chain->level_count; level++) {
+        texture_image_t * image = &chain->levels[level];
+        allocator_free_sized(chain->a, image->pixels, (size_t)image->width * image->height * 4);
+        image->pixels = NULL;
+    }
+    chain->level_count = 1;
+}
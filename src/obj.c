@@ -0,0 +1,466 @@
+#include "obj.h"
+#include "io.h"
+#include "mesh_file.h"
+#include "debug.h"
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define OBJ_MAX_THREADS 64
+
+// Bits of obj_corner_t.relative, the index counts back from the end of the chunk's list
+#define OBJ_RELATIVE_POSITION 1
+#define OBJ_RELATIVE_TEXTURE_COORDINATE 2
+#define OBJ_RELATIVE_NORMAL 4
+
+typedef struct obj_array_t obj_array_t;
+typedef struct obj_corner_t obj_corner_t;
+typedef struct obj_chunk_t obj_chunk_t;
+typedef struct obj_table_entry_t obj_table_entry_t;
+
+struct obj_array_t {
+    void * data;
+    size_t count;
+    size_t capacity;
+};
+
+// One triangle corner, 0 based. Absolute indices count from the start of
+// the file, relative ones from the start of the chunk and may be negative.
+// -1 without the relative bit is a missing index.
+struct obj_corner_t {
+    int32_t position;
+    int32_t texture_coordinate;
+    int32_t normal;
+    uint32_t relative;
+};
+
+struct obj_chunk_t {
+    const char * path;
+    const char * begin;
+    const char * end;
+    allocator_t * a;
+    obj_array_t positions; // float3
+    obj_array_t texture_coordinates; // float2
+    obj_array_t normals; // float3
+    obj_array_t corners;
+};
+
+struct obj_table_entry_t {
+    uint32_t vertex; // UINT32_MAX when the slot is free
+    uint32_t hash;
+};
+
+static void * array_push(obj_array_t * array, size_t size, allocator_t * a) {
+    if(array->count == array->capacity) {
+        size_t capacity = array->capacity ? array->capacity * 2 : 1024;
+        array->data = allocator_realloc(a, array->data, capacity * size);
+        if(!array->data) panic("Failed to grow OBJ array to %zu entries\n", capacity);
+        array->capacity = capacity;
+    }
+    return (char *)array->data + array->count++ * size;
+}
+
+static void array_free(obj_array_t * array, size_t size, allocator_t * a) {
+    if(array->data) allocator_free_sized(a, array->data, array->capacity * size);
+    memset(array, 0, sizeof(*array));
+}
+
+static int is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static const char * skip_space(const char * p, const char * end) {
+    while(p < end && is_space(*p)) p++;
+    return p;
+}
+
+static const char * next_line(const char * p, const char * end) {
+    const char * newline = memchr(p, '\n', end - p);
+    return newline ? newline + 1 : end;
+}
+
+static const double powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// Digits are gathered into an integer and scaled once by an exact power of
+// ten, which is exact to a float for the up to 19 significant digits OBJ
+// writers use. Returns NULL if there is no number at p.
+static const char * parse_float(const char * p, const char * end, float * value) {
+    int negative = 0;
+    if(p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+    uint64_t mantissa = 0;
+    int digits = 0, exponent = 0;
+    const char * start = p;
+    for(; p < end && *p >= '0' && *p <= '9'; p++) {
+        if(digits < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+            if(mantissa) digits++;
+        } else {
+            exponent++;
+        }
+    }
+    if(p < end && *p == '.') {
+        for(p++; p < end && *p >= '0' && *p <= '9'; p++) {
+            if(digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                if(mantissa) digits++;
+                exponent--;
+            }
+        }
+    }
+    if(p == start || (p == start + 1 && *start == '.')) return NULL;
+
+    if(p < end && (*p == 'e' || *p == 'E')) {
+        const char * e = p + 1;
+        int exponent_negative = 0;
+        if(e < end && (*e == '-' || *e == '+')) exponent_negative = *e++ == '-';
+        if(e < end && *e >= '0' && *e <= '9') {
+            int written = 0;
+            for(; e < end && *e >= '0' && *e <= '9'; e++) {
+                if(written < 10000) written = written * 10 + (*e - '0');
+            }
+            exponent += exponent_negative ? -written : written;
+            p = e;
+        }
+    }
+
+    double result = (double)mantissa;
+    while(exponent > 22) {
+        result *= 1e22;
+        exponent -= 22;
+    }
+    while(exponent < -22) {
+        result /= 1e22;
+        exponent += 22;
+    }
+    result = exponent >= 0 ? result * powers_of_ten[exponent] : result / powers_of_ten[-exponent];
+    *value = (float)(negative ? -result : result);
+    return p;
+}
+
+static const char * parse_int(const char * p, const char * end, int64_t * value) {
+    int negative = 0;
+    if(p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+    const char * start = p;
+    int64_t result = 0;
+    for(; p < end && *p >= '0' && *p <= '9'; p++) {
+        if(result < INT32_MAX) result = result * 10 + (*p - '0');
+    }
+    if(p == start) return NULL;
+    *value = negative ? -result : result;
+    return p;
+}
+
+static void chunk_error(obj_chunk_t * chunk, const char * p, const char * what) {
+    const char * line_end = memchr(p, '\n', chunk->end - p);
+    int length = (int)((line_end ? line_end : chunk->end) - p);
+    if(length > 80) length = 80;
+    panic("OBJ %s: %s at \"%.*s\"\n", chunk->path, what, length, p);
+}
+
+static const char * parse_floats(obj_chunk_t * chunk, const char * p, float * out, int count) {
+    for(int i = 0; i < count; i++) {
+        p = skip_space(p, chunk->end);
+        const char * after = parse_float(p, chunk->end, &out[i]);
+        if(!after) chunk_error(chunk, p, "expected a number");
+        p = after;
+    }
+    return p;
+}
+
+// OBJ indices are 1 based, negative ones count back from the last element so far
+static int32_t resolve_index(obj_chunk_t * chunk, const char * p, int64_t index, size_t local_count, uint32_t * relative, uint32_t bit) {
+    if(index > 0) return (int32_t)(index - 1);
+    if(index == 0) chunk_error(chunk, p, "index 0");
+    *relative |= bit;
+    return (int32_t)((int64_t)local_count + index);
+}
+
+static const char * parse_corner(obj_chunk_t * chunk, const char * p, obj_corner_t * corner) {
+    const char * start = p;
+    int64_t index;
+    corner->relative = 0;
+    corner->texture_coordinate = -1;
+    corner->normal = -1;
+
+    p = parse_int(p, chunk->end, &index);
+    if(!p) chunk_error(chunk, start, "expected a vertex index");
+    corner->position = resolve_index(chunk, start, index, chunk->positions.count, &corner->relative, OBJ_RELATIVE_POSITION);
+
+    if(p < chunk->end && *p == '/') {
+        p++;
+        if(p < chunk->end && *p != '/') {
+            p = parse_int(p, chunk->end, &index);
+            if(!p) chunk_error(chunk, start, "expected a texture coordinate index");
+            corner->texture_coordinate = resolve_index(chunk, start, index, chunk->texture_coordinates.count, &corner->relative, OBJ_RELATIVE_TEXTURE_COORDINATE);
+        }
+        if(p < chunk->end && *p == '/') {
+            p = parse_int(p + 1, chunk->end, &index);
+            if(!p) chunk_error(chunk, start, "expected a normal index");
+            corner->normal = resolve_index(chunk, start, index, chunk->normals.count, &corner->relative, OBJ_RELATIVE_NORMAL);
+        }
+    }
+    return p;
+}
+
+static const char * parse_face(obj_chunk_t * chunk, const char * p) {
+    const char * line = p - 1;
+    obj_corner_t first, previous, corner;
+    int count = 0;
+    for(;;) {
+        p = skip_space(p, chunk->end);
+        if(p == chunk->end || *p == '\n' || *p == '#') break;
+        p = parse_corner(chunk, p, &corner);
+
+        if(count >= 2) {
+            obj_corner_t triangle[3] = { first, previous, corner };
+            for(int i = 0; i < 3; i++) *(obj_corner_t *)array_push(&chunk->corners, sizeof(obj_corner_t), chunk->a) = triangle[i];
+        }
+        if(count == 0) first = corner;
+        previous = corner;
+        count++;
+    }
+    if(count < 3) chunk_error(chunk, line, "face with fewer than 3 vertices");
+    return p;
+}
+
+static void parse_chunk(obj_chunk_t * chunk) {
+    const char * p = chunk->begin;
+    const char * end = chunk->end;
+    while(p < end) {
+        p = skip_space(p, end);
+        if(p + 1 < end && p[0] == 'v' && is_space(p[1])) {
+            p = parse_floats(chunk, p + 1, array_push(&chunk->positions, 3 * sizeof(float), chunk->a), 3);
+        } else if(p + 2 < end && p[0] == 'v' && p[1] == 't' && is_space(p[2])) {
+            p = parse_floats(chunk, p + 2, array_push(&chunk->texture_coordinates, 2 * sizeof(float), chunk->a), 2);
+        } else if(p + 2 < end && p[0] == 'v' && p[1] == 'n' && is_space(p[2])) {
+            p = parse_floats(chunk, p + 2, array_push(&chunk->normals, 3 * sizeof(float), chunk->a), 3);
+        } else if(p + 1 < end && p[0] == 'f' && is_space(p[1])) {
+            p = parse_face(chunk, p + 1);
+        }
+        // Comments, groups, materials and anything else are skipped, as is the rest of every line
+        p = next_line(p, end);
+    }
+}
+
+static void * parse_thread(void * argument) {
+    parse_chunk(argument);
+    return NULL;
+}
+
+// Resolves the corners of every chunk to file wide indices and checks them
+static void resolve_corners(obj_chunk_t * chunks, unsigned int chunk_count, const char * path) {
+    size_t positions = 0, texture_coordinates = 0, normals = 0;
+    for(unsigned int c = 0; c < chunk_count; c++) {
+        obj_chunk_t * chunk = &chunks[c];
+        obj_corner_t * corners = chunk->corners.data;
+        for(size_t i = 0; i < chunk->corners.count; i++) {
+            obj_corner_t * corner = &corners[i];
+            if(corner->relative & OBJ_RELATIVE_POSITION) corner->position += (int32_t)positions;
+            if(corner->relative & OBJ_RELATIVE_TEXTURE_COORDINATE) corner->texture_coordinate += (int32_t)texture_coordinates;
+            if(corner->relative & OBJ_RELATIVE_NORMAL) corner->normal += (int32_t)normals;
+            if(corner->position < 0) panic("OBJ %s: vertex index before the first vertex\n", path);
+        }
+        positions += chunk->positions.count;
+        texture_coordinates += chunk->texture_coordinates.count;
+        normals += chunk->normals.count;
+    }
+
+    for(unsigned int c = 0; c < chunk_count; c++) {
+        obj_corner_t * corners = chunks[c].corners.data;
+        for(size_t i = 0; i < chunks[c].corners.count; i++) {
+            obj_corner_t * corner = &corners[i];
+            if((size_t)corner->position >= positions) panic("OBJ %s: vertex index %d out of %zu\n", path, corner->position + 1, positions);
+            if(corner->texture_coordinate >= 0 && (size_t)corner->texture_coordinate >= texture_coordinates) {
+                panic("OBJ %s: texture coordinate index %d out of %zu\n", path, corner->texture_coordinate + 1, texture_coordinates);
+            }
+            if(corner->normal >= 0 && (size_t)corner->normal >= normals) panic("OBJ %s: normal index %d out of %zu\n", path, corner->normal + 1, normals);
+            if(corner->texture_coordinate < -1) panic("OBJ %s: texture coordinate index before the first one\n", path);
+            if(corner->normal < -1) panic("OBJ %s: normal index before the first one\n", path);
+        }
+    }
+}
+
+// Concatenates one list of every chunk, elements of size bytes
+static void * gather(obj_chunk_t * chunks, unsigned int chunk_count, size_t offset_of_array, size_t size, size_t * total, allocator_t * a) {
+    *total = 0;
+    for(unsigned int c = 0; c < chunk_count; c++) *total += ((obj_array_t *)((char *)&chunks[c] + offset_of_array))->count;
+    char * data = allocator_alloc(a, *total * size + 1);
+    if(!data) panic("Failed to allocate %zu OBJ elements\n", *total);
+
+    size_t at = 0;
+    for(unsigned int c = 0; c < chunk_count; c++) {
+        obj_array_t * array = (obj_array_t *)((char *)&chunks[c] + offset_of_array);
+        if(array->count) memcpy(data + at * size, array->data, array->count * size);
+        at += array->count;
+    }
+    return data;
+}
+
+static uint32_t hash_corner(const obj_corner_t * corner) {
+    uint32_t h = (uint32_t)corner->position * 0x9E3779B1u;
+    h ^= (uint32_t)corner->texture_coordinate * 0x85EBCA77u;
+    h ^= (uint32_t)corner->normal * 0xC2B2AE3Du;
+    h ^= h >> 16;
+    h *= 0x7FEB352Du;
+    h ^= h >> 15;
+    return h;
+}
+
+// Gives every distinct corner a vertex, in the order the faces first use them
+static void build_vertices(obj_mesh_t * mesh, obj_chunk_t * chunks, unsigned int chunk_count, const float * positions, const float * texture_coordinates, const float * normals) {
+    allocator_t * a = mesh->a;
+    size_t corner_count = 0;
+    for(unsigned int c = 0; c < chunk_count; c++) corner_count += chunks[c].corners.count;
+
+    // Every corner could be distinct, at that size the table is at most half full. The hash
+    // is kept next to the vertex so most probes are settled without touching unique.
+    size_t table_size = 1024;
+    while(table_size < corner_count * 2) table_size *= 2;
+    size_t table_mask = table_size - 1;
+
+    mesh->index_count = corner_count;
+    mesh->indices = allocator_alloc(a, corner_count * sizeof(unsigned int) + 1);
+    obj_corner_t * unique = allocator_alloc(a, corner_count * sizeof(obj_corner_t) + 1);
+    obj_table_entry_t * table = allocator_alloc(a, table_size * sizeof(obj_table_entry_t));
+    if(!mesh->indices || !unique || !table) panic("Failed to allocate OBJ vertices for %zu corners\n", corner_count);
+    memset(table, 0xff, table_size * sizeof(obj_table_entry_t));
+
+    size_t vertex_count = 0, i = 0;
+    for(unsigned int c = 0; c < chunk_count; c++) {
+        obj_corner_t * corners = chunks[c].corners.data;
+        for(size_t k = 0; k < chunks[c].corners.count; k++, i++) {
+            obj_corner_t * corner = &corners[k];
+            corner->relative = 0;
+
+            uint32_t hash = hash_corner(corner);
+            size_t slot = hash & table_mask;
+            for(;;) {
+                obj_table_entry_t * entry = &table[slot];
+                if(entry->vertex == UINT32_MAX) {
+                    entry->vertex = (uint32_t)vertex_count;
+                    entry->hash = hash;
+                    unique[vertex_count] = *corner;
+                    mesh->indices[i] = (unsigned int)vertex_count++;
+                    break;
+                }
+                if(entry->hash == hash && memcmp(&unique[entry->vertex], corner, sizeof(obj_corner_t)) == 0) {
+                    mesh->indices[i] = entry->vertex;
+                    break;
+                }
+                slot = (slot + 1) & table_mask;
+            }
+        }
+    }
+    allocator_free_sized(a, table, table_size * sizeof(obj_table_entry_t));
+
+    int has_texture_coordinates = texture_coordinates != NULL;
+    int has_normals = normals != NULL;
+    size_t floats = 3 + 2 * has_texture_coordinates + 3 * has_normals;
+    mesh->vertex_count = vertex_count;
+    mesh->vertices = allocator_alloc(a, vertex_count * floats * sizeof(float) + 1);
+    if(!mesh->vertices) panic("Failed to allocate %zu OBJ vertices\n", vertex_count);
+
+    for(size_t v = 0; v < vertex_count; v++) {
+        float * out = mesh->vertices + v * floats;
+        const obj_corner_t * corner = &unique[v];
+        memcpy(out, &positions[corner->position * 3], 3 * sizeof(float));
+        out += 3;
+        if(has_texture_coordinates) {
+            if(corner->texture_coordinate >= 0) memcpy(out, &texture_coordinates[corner->texture_coordinate * 2], 2 * sizeof(float));
+            else out[0] = out[1] = 0.0f;
+            out += 2;
+        }
+        if(has_normals) {
+            if(corner->normal >= 0) memcpy(out, &normals[corner->normal * 3], 3 * sizeof(float));
+            else out[0] = out[1] = out[2] = 0.0f;
+        }
+    }
+    allocator_free_sized(a, unique, corner_count * sizeof(obj_corner_t) + 1);
+}
+
+void obj_load(obj_mesh_t * mesh, const char * path, unsigned int thread_count, allocator_t * a) {
+    io_mapping_t mapping;
+    io_map_file(&mapping, path, IO_ACCESS_SEQUENTIAL, a);
+    const char * data = mapping.data;
+    size_t size = mapping.size;
+
+    if(thread_count == 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = cores > 0 ? (unsigned int)cores : 1;
+    }
+    if(thread_count > OBJ_MAX_THREADS) thread_count = OBJ_MAX_THREADS;
+    // Chunks below 64 KiB cost more to start than they save
+    if(thread_count > size / 65536 + 1) thread_count = (unsigned int)(size / 65536 + 1);
+
+    obj_chunk_t chunks[OBJ_MAX_THREADS];
+    pthread_t threads[OBJ_MAX_THREADS];
+    const char * begin = data;
+    for(unsigned int i = 0; i < thread_count; i++) {
+        const char * end = i + 1 == thread_count ? data + size : data + size * (i + 1) / thread_count;
+        if(end < begin) end = begin;
+        end = end < data + size ? next_line(end, data + size) : end;
+
+        memset(&chunks[i], 0, sizeof(chunks[i]));
+        chunks[i].path = path;
+        chunks[i].begin = begin;
+        chunks[i].end = end;
+        chunks[i].a = a;
+        begin = end;
+    }
+
+    // The calling thread takes the first chunk itself
+    for(unsigned int i = 1; i < thread_count; i++) {
+        if(pthread_create(&threads[i], NULL, parse_thread, &chunks[i]) != 0) panic("Failed to start OBJ parsing thread\n");
+    }
+    parse_chunk(&chunks[0]);
+    for(unsigned int i = 1; i < thread_count; i++) pthread_join(threads[i], NULL);
+
+    resolve_corners(chunks, thread_count, path);
+
+    size_t position_count, texture_coordinate_count, normal_count;
+    float * positions = gather(chunks, thread_count, offsetof(obj_chunk_t, positions), 3 * sizeof(float), &position_count, a);
+    float * texture_coordinates = gather(chunks, thread_count, offsetof(obj_chunk_t, texture_coordinates), 2 * sizeof(float), &texture_coordinate_count, a);
+    float * normals = gather(chunks, thread_count, offsetof(obj_chunk_t, normals), 3 * sizeof(float), &normal_count, a);
+
+    mesh->a = a;
+    vertex_layout_init(&mesh->layout);
+    vertex_layout_add(&mesh->layout, OBJ_LOCATION_POSITION, VERTEX_FORMAT_FLOAT3);
+    if(texture_coordinate_count) vertex_layout_add(&mesh->layout, OBJ_LOCATION_TEXTURE_COORDINATE, VERTEX_FORMAT_FLOAT2);
+    if(normal_count) vertex_layout_add(&mesh->layout, OBJ_LOCATION_NORMAL, VERTEX_FORMAT_FLOAT3);
+    build_vertices(mesh, chunks, thread_count, positions, texture_coordinate_count ? texture_coordinates : NULL, normal_count ? normals : NULL);
+
+    allocator_free_sized(a, positions, position_count * 3 * sizeof(float) + 1);
+    allocator_free_sized(a, texture_coordinates, texture_coordinate_count * 2 * sizeof(float) + 1);
+    allocator_free_sized(a, normals, normal_count * 3 * sizeof(float) + 1);
+    for(unsigned int i = 0; i < thread_count; i++) {
+        array_free(&chunks[i].positions, 3 * sizeof(float), a);
+        array_free(&chunks[i].texture_coordinates, 2 * sizeof(float), a);
+        array_free(&chunks[i].normals, 3 * sizeof(float), a);
+        array_free(&chunks[i].corners, sizeof(obj_corner_t), a);
+    }
+    io_unmap_file(&mapping);
+}
+
+void obj_free(obj_mesh_t * mesh) {
+    allocator_free_sized(mesh->a, mesh->vertices, mesh->vertex_count * mesh->layout.stride + 1);
+    allocator_free_sized(mesh->a, mesh->indices, mesh->index_count * sizeof(unsigned int) + 1);
+    mesh->vertices = NULL;
+    mesh->indices = NULL;
+}
+
+void obj_create_shape(obj_mesh_t * mesh, shape_t * shape) {
+    shape_init(shape);
+    shape_load_vertices(shape, mesh->vertices, mesh->vertex_count * mesh->layout.stride);
+    shape_load_indices(shape, mesh->indices, mesh->index_count * sizeof(unsigned int));
+    shape_set_layout(shape, &mesh->layout);
+}
+
+int obj_write_mesh_file(obj_mesh_t * mesh, const char * path) {
+    return mesh_file_write(path, &mesh->layout, mesh->vertices, mesh->vertex_count, mesh->indices, mesh->index_count, NULL, 0);
+}
@@ -0,0 +1,100 @@
+#include "pool.h"
+#include "debug.h"
+#include <string.h>
+
+#define POOL_NO_SLOT 0xFFFFFFFFu
+
+static void pool_grow(pool_t * pool, uint32_t capacity) {
+    unsigned char * items = allocator_realloc(pool->a, pool->items, capacity * pool->item_size);
+    uint32_t * item_slots = allocator_realloc(pool->a, pool->item_slots, capacity * sizeof(uint32_t));
+    pool_slot_t * slots = allocator_realloc(pool->a, pool->slots, capacity * sizeof(pool_slot_t));
+    if(!items || !item_slots || !slots) panic("Failed to grow pool to %u records\n", capacity);
+
+    // Chain the new slots in front of the free list
+    for(uint32_t i = capacity; i > pool->capacity; i--) {
+        slots[i - 1].generation = 1;
+        slots[i - 1].dense = pool->free_head;
+        pool->free_head = i - 1;
+    }
+
+    pool->items = items;
+    pool->item_slots = item_slots;
+    pool->slots = slots;
+    pool->capacity = capacity;
+}
+
+void pool_init(pool_t * pool, size_t item_size, uint32_t capacity, allocator_t * a) {
+    pool->a = a;
+    pool->item_size = item_size;
+    pool->items = NULL;
+    pool->item_slots = NULL;
+    pool->slots = NULL;
+    pool->count = 0;
+    pool->capacity = 0;
+    pool->free_head = POOL_NO_SLOT;
+    pool_grow(pool, capacity ? capacity : 1);
+}
+
+void pool_deinit(pool_t * pool) {
+    allocator_free_sized(pool->a, pool->items, pool->capacity * pool->item_size);
+    allocator_free_sized(pool->a, pool->item_slots, pool->capacity * sizeof(uint32_t));
+    allocator_free_sized(pool->a, pool->slots, pool->capacity * sizeof(pool_slot_t));
+    pool->items = NULL;
+    pool->item_slots = NULL;
+    pool->slots = NULL;
+    pool->count = 0;
+    pool->capacity = 0;
+}
+
+pool_handle_t pool_alloc(pool_t * pool) {
+    if(pool->free_head == POOL_NO_SLOT) pool_grow(pool, pool->capacity * 2);
+
+    uint32_t slot = pool->free_head;
+    pool->free_head = pool->slots[slot].dense;
+
+    uint32_t dense = pool->count++;
+    pool->slots[slot].dense = dense;
+    pool->item_slots[dense] = slot;
+    memset(pool->items + dense * pool->item_size, 0, pool->item_size);
+
+    pool_handle_t handle = { slot, pool->slots[slot].generation };
+    return handle;
+}
+
+int pool_is_alive(pool_t * pool, pool_handle_t handle) {
+    if(handle.index >= pool->capacity) return 0;
+    pool_slot_t * slot = &pool->slots[handle.index];
+    return slot->generation == handle.generation && slot->dense < pool->count && pool->item_slots[slot->dense] == handle.index;
+}
+
+void pool_free(pool_t * pool, pool_handle_t handle) {
+    if(!pool_is_alive(pool, handle)) panic("pool_free: stale handle %u generation %u\n", handle.index, handle.generation);
+
+    pool_slot_t * slot = &pool->slots[handle.index];
+    uint32_t dense = slot->dense;
+    uint32_t last = --pool->count;
+
+    // Move the last record into the hole to keep items packed
+    if(dense != last) {
+        memcpy(pool->items + dense * pool->item_size, pool->items + last * pool->item_size, pool->item_size);
+        uint32_t moved = pool->item_slots[last];
+        pool->item_slots[dense] = moved;
+        pool->slots[moved].dense = dense;
+    }
+
+    slot->generation++;
+    if(slot->generation == 0) slot->generation = 1;
+    slot->dense = pool->free_head;
+    pool->free_head = handle.index;
+}
+
+void * pool_get(pool_t * pool, pool_handle_t handle) {
+    if(!pool_is_alive(pool, handle)) return NULL;
+    return pool->items + pool->slots[handle.index].dense * pool->item_size;
+}
+
+pool_handle_t pool_handle_at(pool_t * pool, uint32_t i) {
+    uint32_t slot = pool->item_slots[i];
+    pool_handle_t handle = { slot, pool->slots[slot].generation };
+    return handle;
+}
@@ -1,14 +1,133 @@
 #include "shader.h"
 #include "io.h"
 #include "debug.h"
+#include "gl_state.h"
 #include <stdio.h>
+#include <string.h>
 
-shader_t shader_compile(GLenum shader_type, const char * path, allocator_t * a) {
+#define SHADER_MAX_PROGRAMS 64
+#define SHADER_UNIFORM_NAME_LENGTH 256
+
+typedef struct uniform_entry_t uniform_entry_t;
+typedef struct program_uniforms_t program_uniforms_t;
+
+struct uniform_entry_t {
+    char * name; // NULL if the slot is empty
+    unsigned int hash;
+    shader_uniform_t location;
+};
+
+// Open addressing table of name -> location, capacity is always a power of 2
+struct program_uniforms_t {
+    shader_program_t program; // 0 if the record is unused
+    allocator_t * a;
+    uniform_entry_t * entries;
+    unsigned int capacity;
+    unsigned int count;
+};
+
+static program_uniforms_t programs[SHADER_MAX_PROGRAMS];
+static program_uniforms_t * last_program = NULL;
+
+static unsigned int hash_name(const char * name) {
+    // FNV-1a
+    unsigned int hash = 2166136261u;
+    while(*name) {
+        hash ^= (unsigned char)*name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static program_uniforms_t * find_program(shader_program_t program) {
+    if(program == 0) return NULL;
+    if(last_program && last_program->program == program) return last_program;
+
+    for(int i = 0; i < SHADER_MAX_PROGRAMS; i++) {
+        if(programs[i].program == program) {
+            last_program = &programs[i];
+            return last_program;
+        }
+    }
+
+    return NULL;
+}
+
+static uniform_entry_t * find_slot(uniform_entry_t * entries, unsigned int capacity, const char * name, unsigned int hash) {
+    unsigned int mask = capacity - 1;
+    unsigned int i = hash & mask;
+    while(entries[i].name) {
+        if(entries[i].hash == hash && strcmp(entries[i].name, name) == 0) break;
+        i = (i + 1) & mask;
+    }
+    return &entries[i];
+}
+
+static void uniforms_grow(program_uniforms_t * uniforms, unsigned int capacity) {
+    uniform_entry_t * entries = allocator_clean_alloc(uniforms->a, capacity, sizeof(uniform_entry_t));
+    if(!entries) panic("Failed to allocate uniform table of %u entries\n", capacity);
+
+    for(unsigned int i = 0; i < uniforms->capacity; i++) {
+        uniform_entry_t * old = &uniforms->entries[i];
+        if(!old->name) continue;
+        *find_slot(entries, capacity, old->name, old->hash) = *old;
+    }
+
+    if(uniforms->entries) allocator_free_sized(uniforms->a, uniforms->entries, uniforms->capacity * sizeof(uniform_entry_t));
+    uniforms->entries = entries;
+    uniforms->capacity = capacity;
+}
+
+static void uniforms_insert(program_uniforms_t * uniforms, const char * name, unsigned int hash, shader_uniform_t location) {
+    // Keep the load factor at or below 1/2 so probe sequences stay short
+    if((uniforms->count + 1) * 2 > uniforms->capacity) uniforms_grow(uniforms, uniforms->capacity * 2);
+
+    uniform_entry_t * entry = find_slot(uniforms->entries, uniforms->capacity, name, hash);
+    if(entry->name) {
+        entry->location = location;
+        return;
+    }
+
+    size_t length = strlen(name);
+    entry->name = allocator_alloc(uniforms->a, length + 1);
+    if(!entry->name) panic("Failed to allocate uniform name %s\n", name);
+    memcpy(entry->name, name, length + 1);
+    entry->hash = hash;
+    entry->location = location;
+    uniforms->count++;
+}
+
+static void uniforms_build(program_uniforms_t * uniforms) {
+    int active_uniforms;
+    glGetProgramiv(uniforms->program, GL_ACTIVE_UNIFORMS, &active_uniforms);
+
+    unsigned int capacity = 8;
+    while(capacity < (unsigned int)active_uniforms * 2) capacity *= 2;
+    uniforms_grow(uniforms, capacity);
+
+    char name[SHADER_UNIFORM_NAME_LENGTH];
+    for(int i = 0; i < active_uniforms; i++) {
+        int length, size;
+        GLenum type;
+        glGetActiveUniform(uniforms->program, i, sizeof(name), &length, &size, &type, name);
+        shader_uniform_t location = glGetUniformLocation(uniforms->program, name);
+        // Members of uniform blocks have no location
+        if(location < 0) continue;
+
+        uniforms_insert(uniforms, name, hash_name(name), location);
+
+        // Arrays are reported as "name[0]", also make them reachable as "name"
+        if(length > 3 && strcmp(name + length - 3, "[0]") == 0) {
+            name[length - 3] = 0;
+            uniforms_insert(uniforms, name, hash_name(name), location);
+        }
+    }
+}
+
+shader_t shader_compile_source(GLenum shader_type, const char * source) {
     shader_t shader = glCreateShader(shader_type);
-    const char * shader_source = read_entire_file(path, a);
-    glShaderSource(shader, 1, &shader_source, NULL);
+    glShaderSource(shader, 1, &source, NULL);
     glCompileShader(shader);
-    allocator_free(a, (void*)shader_source);
 
     int success;
     char info_log[512];
@@ -24,11 +143,20 @@ shader_t shader_compile(GLenum shader_type, const char * path, allocator_t * a)
     return shader;
 }
 
+shader_t shader_compile(GLenum shader_type, const char * path, allocator_t * a) {
+    size_t shader_source_size;
+    char * shader_source = read_entire_file_sized(path, &shader_source_size, a);
+    shader_t shader = shader_compile_source(shader_type, shader_source);
+    allocator_free_sized(a, shader_source, shader_source_size + 1);
+
+    return shader;
+}
+
 void shader_delete(shader_t shader) {
     glDeleteShader(shader);
 }
 
-shader_program_t shader_program_link(shader_t vertex_shader, shader_t fragment_shader) {
+shader_program_t shader_program_link(shader_t vertex_shader, shader_t fragment_shader, allocator_t * a) {
     shader_program_t program = glCreateProgram();
     glAttachShader(program, vertex_shader);
     glAttachShader(program, fragment_shader);
@@ -42,83 +170,160 @@ shader_program_t shader_program_link(shader_t vertex_shader, shader_t fragment_s
         panic("Shader link error: %s\n", info_log);
     }
 
+    program_uniforms_t * uniforms = NULL;
+    for(int i = 0; i < SHADER_MAX_PROGRAMS && !uniforms; i++) {
+        if(programs[i].program == 0) uniforms = &programs[i];
+    }
+    if(!uniforms) panic("Too many shader programs, at most %d are supported\n", SHADER_MAX_PROGRAMS);
+    uniforms->program = program;
+    uniforms->a = a;
+    uniforms->entries = NULL;
+    uniforms->capacity = 0;
+    uniforms->count = 0;
+    uniforms_build(uniforms);
+
     return program;
 }
 
+void shader_program_delete(shader_program_t program) {
+    program_uniforms_t * uniforms = find_program(program);
+    if(uniforms) {
+        for(unsigned int i = 0; i < uniforms->capacity; i++) {
+            char * name = uniforms->entries[i].name;
+            if(name) allocator_free_sized(uniforms->a, name, strlen(name) + 1);
+        }
+        allocator_free_sized(uniforms->a, uniforms->entries, uniforms->capacity * sizeof(uniform_entry_t));
+        uniforms->program = 0;
+        uniforms->entries = NULL;
+        last_program = NULL;
+    }
+    gl_state_forget_program(program);
+    glDeleteProgram(program);
+}
+
 void shader_program_use(shader_program_t program) {
-    glUseProgram(program);
+    gl_state_use_program(program);
+}
+
+shader_uniform_t shader_program_get_uniform(shader_program_t program, const char * name) {
+    program_uniforms_t * uniforms = find_program(program);
+    if(!uniforms) return glGetUniformLocation(program, name);
+
+    unsigned int hash = hash_name(name);
+    uniform_entry_t * entry = find_slot(uniforms->entries, uniforms->capacity, name, hash);
+    if(entry->name) return entry->location;
+
+    // Names not reported by glGetActiveUniform (array elements, struct members) are asked once and remembered, misses included
+    shader_uniform_t location = glGetUniformLocation(program, name);
+    uniforms_insert(uniforms, name, hash, location);
+    return location;
 }
 
 void shader_program_set_int(shader_program_t program, const char * name, int value) {
-    shader_program_use(program);
-    int location = glGetUniformLocation(program, name);
-    glUniform1i(location, value);
+    shader_program_set_uniform_int(program, shader_program_get_uniform(program, name), value);
 }
 
 void shader_program_set_2_int(shader_program_t program, const char * name, int value1, int value2) {
-    shader_program_use(program);
-    int location = glGetUniformLocation(program, name);
-    glUniform2i(location, value1, value2);
+    shader_program_set_uniform_2_int(program, shader_program_get_uniform(program, name), value1, value2);
 }
 
 void shader_program_set_3_int(shader_program_t program, const char * name, int value1, int value2, int value3) {
-    shader_program_use(program);
-    int location = glGetUniformLocation(program, name);
-    glUniform3i(location, value1, value2, value3);
+    shader_program_set_uniform_3_int(program, shader_program_get_uniform(program, name), value1, value2, value3);
 }
 
 void shader_program_set_4_int(shader_program_t program, const char * name, int value1, int value2, int value3, int value4) {
-    shader_program_use(program);
-    int location = glGetUniformLocation(program, name);
-    glUniform4i(location, value1, value2, value3, value4);
+    shader_program_set_uniform_4_int(program, shader_program_get_uniform(program, name), value1, value2, value3, value4);
 }
 
 void shader_program_set_unsigned_int(shader_program_t program, const char * name, unsigned int value) {
-    shader_program_use(program);
-    int location = glGetUniformLocation(program, name);
-    glUniform1ui(location, value);
+    shader_program_set_uniform_unsigned_int(program, shader_program_get_uniform(program, name), value);
 }
 
 void shader_program_set_2_unsigned_int(shader_program_t program, const char * name, unsigned int value1, unsigned int value2) {
-    shader_program_use(program);
-    int location = glGetUniformLocation(program, name);
-    glUniform2ui(location, value1, value2);
+    shader_program_set_uniform_2_unsigned_int(program, shader_program_get_uniform(program, name), value1, value2);
 }
 
 void shader_program_set_3_unsigned_int(shader_program_t program, const char * name, unsigned int value1, unsigned int value2, unsigned int value3) {
-    shader_program_use(program);
-    int location = glGetUniformLocation(program, name);
-    glUniform3ui(location, value1, value2, value3);
+    shader_program_set_uniform_3_unsigned_int(program, shader_program_get_uniform(program, name), value1, value2, value3);
 }
 
 void shader_program_set_4_unsigned_int(shader_program_t program, const char * name, unsigned int value1, unsigned int value2, unsigned int value3, unsigned int value4) {
-    shader_program_use(program);
-    int location = glGetUniformLocation(program, name);
-    glUniform4ui(location, value1, value2, value3, value4);
+    shader_program_set_uniform_4_unsigned_int(program, shader_program_get_uniform(program, name), value1, value2, value3, value4);
 }
 
 void shader_program_set_float(shader_program_t program, const char * name, float value) {
-    shader_program_use(program);
-    int location = glGetUniformLocation(program, name);
-    glUniform1f(location, value);
+    shader_program_set_uniform_float(program, shader_program_get_uniform(program, name), value);
 }
 
 void shader_program_set_2_float(shader_program_t program, const char * name, float value1, float value2) {
-    shader_program_use(program);
-    int location = glGetUniformLocation(program, name);
-    glUniform2f(location, value1, value2);
+    shader_program_set_uniform_2_float(program, shader_program_get_uniform(program, name), value1, value2);
 }
 
 void shader_program_set_3_float(shader_program_t program, const char * name, float value1, float value2, float value3) {
-    shader_program_use(program);
-    int location = glGetUniformLocation(program, name);
-    glUniform3f(location, value1, value2, value3);
+    shader_program_set_uniform_3_float(program, shader_program_get_uniform(program, name), value1, value2, value3);
 }
 
 void shader_program_set_4_float(shader_program_t program, const char * name, float value1, float value2, float value3, float value4) {
+    shader_program_set_uniform_4_float(program, shader_program_get_uniform(program, name), value1, value2, value3, value4);
+}
+
+void shader_program_set_uniform_int(shader_program_t program, shader_uniform_t uniform, int value) {
+    shader_program_use(program);
+    glUniform1i(uniform, value);
+}
+
+void shader_program_set_uniform_2_int(shader_program_t program, shader_uniform_t uniform, int value1, int value2) {
+    shader_program_use(program);
+    glUniform2i(uniform, value1, value2);
+}
+
+void shader_program_set_uniform_3_int(shader_program_t program, shader_uniform_t uniform, int value1, int value2, int value3) {
+    shader_program_use(program);
+    glUniform3i(uniform, value1, value2, value3);
+}
+
+void shader_program_set_uniform_4_int(shader_program_t program, shader_uniform_t uniform, int value1, int value2, int value3, int value4) {
     shader_program_use(program);
-    int location = glGetUniformLocation(program, name);
-    glUniform4f(location, value1, value2, value3, value4);
+    glUniform4i(uniform, value1, value2, value3, value4);
 }
 
+void shader_program_set_uniform_unsigned_int(shader_program_t program, shader_uniform_t uniform, unsigned int value) {
+    shader_program_use(program);
+    glUniform1ui(uniform, value);
+}
+
+void shader_program_set_uniform_2_unsigned_int(shader_program_t program, shader_uniform_t uniform, unsigned int value1, unsigned int value2) {
+    shader_program_use(program);
+    glUniform2ui(uniform, value1, value2);
+}
+
+void shader_program_set_uniform_3_unsigned_int(shader_program_t program, shader_uniform_t uniform, unsigned int value1, unsigned int value2, unsigned int value3) {
+    shader_program_use(program);
+    glUniform3ui(uniform, value1, value2, value3);
+}
+
+void shader_program_set_uniform_4_unsigned_int(shader_program_t program, shader_uniform_t uniform, unsigned int value1, unsigned int value2, unsigned int value3, unsigned int value4) {
+    shader_program_use(program);
+    glUniform4ui(uniform, value1, value2, value3, value4);
+}
+
+void shader_program_set_uniform_float(shader_program_t program, shader_uniform_t uniform, float value) {
+    shader_program_use(program);
+    glUniform1f(uniform, value);
+}
+
+void shader_program_set_uniform_2_float(shader_program_t program, shader_uniform_t uniform, float value1, float value2) {
+    shader_program_use(program);
+    glUniform2f(uniform, value1, value2);
+}
+
+void shader_program_set_uniform_3_float(shader_program_t program, shader_uniform_t uniform, float value1, float value2, float value3) {
+    shader_program_use(program);
+    glUniform3f(uniform, value1, value2, value3);
+}
+
+void shader_program_set_uniform_4_float(shader_program_t program, shader_uniform_t uniform, float value1, float value2, float value3, float value4) {
+    shader_program_use(program);
+    glUniform4f(uniform, value1, value2, value3, value4);
+}
 
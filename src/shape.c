@@ -1,42 +1,214 @@
 #include "shape.h"
+#include "gl_state.h"
+#include "debug.h"
+#include <stdint.h>
+
+// Indices converted per glBufferSubData when they are stored smaller than given
+#define SHAPE_INDEX_CHUNK 4096
+
+static size_t index_size(GLenum index_type) {
+    switch(index_type) {
+        case GL_UNSIGNED_BYTE: return 1;
+        case GL_UNSIGNED_SHORT: return 2;
+        default: return 4;
+    }
+}
+
+// Writes indices - base as 16 bit at offset bytes of the bound EBO, a chunk at a time
+static void upload_short_indices(const unsigned int * indices, size_t count, unsigned int base, size_t offset) {
+    uint16_t converted[SHAPE_INDEX_CHUNK];
+    for(size_t first = 0; first < count; first += SHAPE_INDEX_CHUNK) {
+        size_t n = count - first < SHAPE_INDEX_CHUNK ? count - first : SHAPE_INDEX_CHUNK;
+        for(size_t i = 0; i < n; i++) converted[i] = (uint16_t)(indices[first + i] - base);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, offset + first * sizeof(uint16_t), n * sizeof(uint16_t), converted);
+    }
+}
 
 void shape_init(shape_t *shape) {
     shape->element_count = 0;
+    shape->index_type = GL_UNSIGNED_INT;
+    shape->base_vertex = 0;
+    shape->first_index = 0;
     glGenVertexArrays(1, &shape->VAO);
     glGenBuffers(1, &shape->VBO);
     glGenBuffers(1, &shape->EBO);
+    shape->instance_VBO = 0;
+}
+
+void shape_init_streamed(shape_t * shape, stream_buffer_t * stream) {
+    shape->element_count = 0;
+    shape->index_type = GL_UNSIGNED_INT;
+    shape->base_vertex = 0;
+    shape->first_index = 0;
+    glGenVertexArrays(1, &shape->VAO);
+    shape->VBO = stream->buffer;
+    glGenBuffers(1, &shape->EBO);
+    shape->instance_VBO = 0;
 }
 
-void shape_load_vertices(shape_t * shape, float * vertices, size_t vertices_size) {
-    glBindVertexArray(shape->VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, shape->VBO);
+void shape_init_from_buffers(shape_t * shape, unsigned int VBO, unsigned int EBO) {
+    shape->element_count = 0;
+    shape->index_type = GL_UNSIGNED_INT;
+    shape->base_vertex = 0;
+    shape->first_index = 0;
+    glGenVertexArrays(1, &shape->VAO);
+    shape->VBO = VBO;
+    shape->EBO = EBO;
+    shape->instance_VBO = 0;
+
+    // The element array binding is part of the VAO
+    gl_state_bind_vertex_array(shape->VAO);
+    if(EBO) gl_state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+}
+
+void shape_load_vertices(shape_t * shape, const void * vertices, size_t vertices_size) {
+    gl_state_bind_vertex_array(shape->VAO);
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, shape->VBO);
 
     glBufferData(GL_ARRAY_BUFFER, vertices_size, vertices, GL_STATIC_DRAW);
 
-    //glBindVertexArray(0);
+    //gl_state_bind_vertex_array(0);
+}
+
+void shape_stream_vertices(shape_t * shape, stream_buffer_t * stream, void * vertices, size_t vertices_size, size_t stride) {
+    size_t offset = stream_buffer_write(stream, vertices, vertices_size, stride);
+    shape->base_vertex = (int)(offset / stride);
 }
 
 void shape_load_indices(shape_t * shape, unsigned int * indices, size_t indices_size) {
-    glBindVertexArray(shape->VAO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, shape->EBO);
+    gl_state_bind_vertex_array(shape->VAO);
+    gl_state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, shape->EBO);
+
+    size_t count = indices_size / sizeof(unsigned int);
+    unsigned int max_index = 0;
+    for(size_t i = 0; i < count; i++) {
+        if(indices[i] > max_index) max_index = indices[i];
+    }
+
+    if(max_index <= UINT16_MAX) {
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, count * sizeof(uint16_t), NULL, GL_STATIC_DRAW);
+        upload_short_indices(indices, count, 0, 0);
+        shape->index_type = GL_UNSIGNED_SHORT;
+    } else {
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices_size, indices, GL_STATIC_DRAW);
+        shape->index_type = GL_UNSIGNED_INT;
+    }
+
+    //gl_state_bind_vertex_array(0);
+
+    shape->element_count = count;
+    shape->first_index = 0;
+}
+
+void shape_load_indices_typed(shape_t * shape, const void * indices, size_t indices_size, GLenum index_type) {
+    gl_state_bind_vertex_array(shape->VAO);
+    gl_state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, shape->EBO);
 
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices_size, indices, GL_STATIC_DRAW);
 
-    //glBindVertexArray(0);
+    shape->index_type = index_type;
+    shape->element_count = indices_size / index_size(index_type);
+    shape->first_index = 0;
+}
+
+size_t shape_load_indices_split(shape_t * shape, shape_t * chunks, size_t max_chunks, unsigned int * indices, size_t indices_size) {
+    size_t count = indices_size / sizeof(unsigned int);
+    if(count % 3 != 0) panic("Splitting %zu indices, not whole triangles\n", count);
+
+    size_t chunk_count = 0;
+    size_t first = 0;
+    unsigned int low = UINT32_MAX, high = 0;
+    for(size_t i = 0; i <= count; i += 3) {
+        unsigned int triangle_low = low, triangle_high = high;
+        if(i < count) {
+            for(int corner = 0; corner < 3; corner++) {
+                if(indices[i + corner] < triangle_low) triangle_low = indices[i + corner];
+                if(indices[i + corner] > triangle_high) triangle_high = indices[i + corner];
+            }
+        }
+
+        if(i == count || triangle_high - triangle_low > UINT16_MAX) {
+            if(i == first) {
+                if(i < count) panic("Triangle %zu references vertices more than 65535 apart\n", i / 3);
+                break;
+            }
+            if(chunk_count == max_chunks) panic("Splitting %zu indices needs more than %zu chunks\n", count, max_chunks);
+
+            shape_t * chunk = &chunks[chunk_count++];
+            *chunk = *shape;
+            chunk->index_type = GL_UNSIGNED_SHORT;
+            chunk->base_vertex = shape->base_vertex + (int)low;
+            chunk->first_index = first;
+            chunk->element_count = i - first;
+
+            first = i;
+            low = UINT32_MAX;
+            high = 0;
+            i -= 3; // the triangle starts the next chunk
+            continue;
+        }
+        low = triangle_low;
+        high = triangle_high;
+    }
+
+    gl_state_bind_vertex_array(shape->VAO);
+    gl_state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, shape->EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, count * sizeof(uint16_t), NULL, GL_STATIC_DRAW);
+    for(size_t c = 0; c < chunk_count; c++) {
+        shape_t * chunk = &chunks[c];
+        unsigned int base = chunk->base_vertex - shape->base_vertex;
+        upload_short_indices(&indices[chunk->first_index], chunk->element_count, base, chunk->first_index * sizeof(uint16_t));
+    }
+
+    shape->index_type = GL_UNSIGNED_SHORT;
+    shape->element_count = 0;
+    shape->first_index = 0;
+    return chunk_count;
+}
+
+void shape_set_layout(shape_t * shape, const vertex_layout_t * layout) {
+    gl_state_bind_vertex_array(shape->VAO);
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, shape->VBO);
 
-    shape->element_count = indices_size / sizeof(unsigned int);
+    vertex_layout_apply(layout);
 }
 
 void shape_interpret_and_enable(shape_t * shape ,unsigned int location, int vector_size, GLenum data_type, GLboolean normalised, size_t stride, void * offset_in_data) {
-    glBindVertexArray(shape->VAO);
+    shape_interpret_buffer_and_enable(shape, shape->VBO, location, vector_size, data_type, normalised, stride, offset_in_data);
+}
+
+void shape_interpret_buffer_and_enable(shape_t * shape, unsigned int buffer, unsigned int location, int vector_size, GLenum data_type, GLboolean normalised, size_t stride, void * offset_in_data) {
+    gl_state_bind_vertex_array(shape->VAO);
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, buffer);
 
     glVertexAttribPointer(location, vector_size, data_type, normalised, stride, offset_in_data);
     glEnableVertexAttribArray(location);
+}
 
-    //glBindVertexArray(0);
+void shape_set_instance_data(shape_t * shape, void * data, size_t data_size) {
+    if(!shape->instance_VBO) glGenBuffers(1, &shape->instance_VBO);
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, shape->instance_VBO);
+
+    // Respecifying the whole store lets the driver hand out fresh memory instead of waiting on earlier draws
+    glBufferData(GL_ARRAY_BUFFER, data_size, data, GL_DYNAMIC_DRAW);
+}
+
+void shape_interpret_instanced_and_enable(shape_t * shape, unsigned int location, int vector_size, GLenum data_type, GLboolean normalised, size_t stride, void * offset_in_data, unsigned int divisor) {
+    if(!shape->instance_VBO) glGenBuffers(1, &shape->instance_VBO);
+    gl_state_bind_vertex_array(shape->VAO);
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, shape->instance_VBO);
+
+    glVertexAttribPointer(location, vector_size, data_type, normalised, stride, offset_in_data);
+    glEnableVertexAttribArray(location);
+    glVertexAttribDivisor(location, divisor);
 }
 
 void shape_draw(shape_t * shape) {
-    glBindVertexArray(shape->VAO);
-    glDrawElements(GL_TRIANGLES, shape->element_count, GL_UNSIGNED_INT, 0);
+    gl_state_bind_vertex_array(shape->VAO);
+    glDrawElementsBaseVertex(GL_TRIANGLES, shape->element_count, shape->index_type, (void *)(shape->first_index * index_size(shape->index_type)), shape->base_vertex);
+}
+
+void shape_draw_instanced(shape_t * shape, unsigned int instance_count) {
+    gl_state_bind_vertex_array(shape->VAO);
+    glDrawElementsInstancedBaseVertex(GL_TRIANGLES, shape->element_count, shape->index_type, (void *)(shape->first_index * index_size(shape->index_type)), instance_count, shape->base_vertex);
 }
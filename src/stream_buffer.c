@@ -0,0 +1,99 @@
+#include "stream_buffer.h"
+#include "gl_state.h"
+#include "debug.h"
+#include <time.h>
+#include <string.h>
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void allocate(stream_buffer_t * stream) {
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, stream->buffer);
+    glBufferData(GL_ARRAY_BUFFER, stream->region_size * STREAM_BUFFER_REGIONS, NULL, GL_STREAM_DRAW);
+
+    // The new store is not read by anything yet
+    for(int i = 0; i < STREAM_BUFFER_REGIONS; i++) {
+        if(stream->fences[i]) glDeleteSync(stream->fences[i]);
+        stream->fences[i] = 0;
+    }
+    stream->region = 0;
+    stream->offset = 0;
+}
+
+void stream_buffer_init(stream_buffer_t * stream, size_t region_size) {
+    memset(stream, 0, sizeof(*stream));
+    stream->region_size = region_size;
+    glGenBuffers(1, &stream->buffer);
+    allocate(stream);
+}
+
+void stream_buffer_deinit(stream_buffer_t * stream) {
+    for(int i = 0; i < STREAM_BUFFER_REGIONS; i++) {
+        if(stream->fences[i]) glDeleteSync(stream->fences[i]);
+    }
+    gl_state_forget_buffer(stream->buffer);
+    glDeleteBuffers(1, &stream->buffer);
+    stream->buffer = 0;
+}
+
+size_t stream_buffer_write(stream_buffer_t * stream, const void * data, size_t size, size_t alignment) {
+    // Aligned within the whole buffer, regions need not be multiples of the alignment
+    size_t base = stream->region * stream->region_size;
+    size_t offset = base + stream->offset;
+    if(alignment > 1) offset = (offset + alignment - 1) / alignment * alignment;
+
+    if(offset + size > base + stream->region_size) {
+        // Orphaning now would take the vertices of this frame's earlier writes along, before they are drawn
+        if(stream->frame.writes > 0) {
+            panic("Stream buffer region of %zu bytes overflowed, a frame wrote %zu bytes and then %zu more\n", stream->region_size, stream->frame.bytes, size);
+        }
+        if(size + alignment > stream->region_size) stream->region_size = size + alignment;
+        allocate(stream);
+        stream->frame.orphans++;
+        offset = 0;
+    }
+
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, stream->buffer);
+    void * mapped = glMapBufferRange(GL_ARRAY_BUFFER, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    int written = 0;
+    if(mapped) {
+        memcpy(mapped, data, size);
+        written = glUnmapBuffer(GL_ARRAY_BUFFER) == GL_TRUE;
+    }
+    // The range is still ours to write, no draw reads it before the next fence comes back
+    if(!written) glBufferSubData(GL_ARRAY_BUFFER, offset, size, data);
+
+    stream->offset = offset + size - stream->region * stream->region_size;
+    stream->frame.bytes += size;
+    stream->frame.writes++;
+    return offset;
+}
+
+void stream_buffer_end_frame(stream_buffer_t * stream) {
+    if(stream->fences[stream->region]) glDeleteSync(stream->fences[stream->region]);
+    stream->fences[stream->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    stream->region = (stream->region + 1) % STREAM_BUFFER_REGIONS;
+    stream->offset = 0;
+
+    GLsync fence = stream->fences[stream->region];
+    if(fence) {
+        if(glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+            double start = now_seconds();
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            stream->frame.stall_seconds += now_seconds() - start;
+        }
+        glDeleteSync(fence);
+        stream->fences[stream->region] = 0;
+    }
+
+    stream->last_frame = stream->frame;
+    memset(&stream->frame, 0, sizeof(stream->frame));
+}
+
+stream_buffer_stats_t stream_buffer_get_stats(stream_buffer_t * stream) {
+    return stream->last_frame;
+}
@@ -1,15 +1,435 @@
 #include "texture.h"
 #include "stb_image.h"
 #include "debug.h"
+#include "gl_state.h"
+#include "mipmap.h"
+#include "texture_cache.h"
+#include <time.h>
+#include <string.h>
 
-void texture_init(texture_t * texture, const char * path) {
-    int width, height, channels;
-    unsigned char * data = stbi_load(path, &width, &height, &channels, 0);
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void create_texture(texture_t * texture) {
     glGenTextures(1, texture);
-    glBindTexture(GL_TEXTURE_2D, *texture);
+    gl_state_bind_texture(GL_TEXTURE_2D, *texture);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 }
+
+static void upload_image(texture_t texture, texture_image_t * image) {
+    gl_state_bind_texture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, image->width, image->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image->pixels);
+}
+
+// Copies the pixels into the next buffer of the ring, the driver then
+// copies them into the texture on its own time instead of blocking here.
+// A buffer large enough is reused unsynchronised once its fence has
+// signalled, otherwise its storage is orphaned by reallocating it.
+// Compressed data is passed on as is, anything else is RGBA8.
+static void upload_streamed(texture_loader_t * loader, texture_t texture, int level, GLenum internal_format, int width, int height, const void * data, size_t size, int compressed, int allocate) {
+    texture_pbo_t * pbo = &loader->pbos[loader->next_pbo];
+    loader->next_pbo = (loader->next_pbo + 1) % TEXTURE_PBO_RING_SIZE;
+
+    if(!pbo->buffer) glGenBuffers(1, &pbo->buffer);
+    gl_state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, pbo->buffer);
+
+    // Nothing here waits on purpose, but the driver may still block in any of these calls, so they are
+    // timed. The copy into the mapping is not.
+    double start = now_seconds();
+
+    // Polled, never waited on, a copy still reading the buffer keeps the orphaned storage
+    GLenum status = pbo->fence ? glClientWaitSync(pbo->fence, 0, 0) : GL_ALREADY_SIGNALED;
+    int busy = status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED;
+
+    GLbitfield access = GL_MAP_WRITE_BIT;
+    if(size > pbo->size || busy) {
+        if(size > pbo->size) pbo->size = size;
+        else loader->frame.orphans++;
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, pbo->size, NULL, GL_STREAM_DRAW);
+        access |= GL_MAP_INVALIDATE_BUFFER_BIT;
+    } else {
+        access |= GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+    }
+    if(pbo->fence) {
+        glDeleteSync(pbo->fence);
+        pbo->fence = 0;
+    }
+
+    void * mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, access);
+    double stalled = now_seconds() - start;
+    int streamed = 0;
+    if(mapped) {
+        memcpy(mapped, data, size);
+        start = now_seconds();
+        // The contents are undefined if unmapping fails, upload from client memory then
+        streamed = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE;
+        stalled += now_seconds() - start;
+    }
+    if(!streamed) gl_state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    const void * pixels = streamed ? (const void *)0 : data;
+
+    start = now_seconds();
+    gl_state_bind_texture(GL_TEXTURE_2D, texture);
+    if(compressed) {
+        if(allocate) glCompressedTexImage2D(GL_TEXTURE_2D, level, internal_format, width, height, 0, size, pixels);
+        else glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, internal_format, size, pixels);
+    } else {
+        if(allocate) glTexImage2D(GL_TEXTURE_2D, level, internal_format, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        else glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    }
+    stalled += now_seconds() - start;
+
+    if(streamed) {
+        pbo->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        // Client memory uploads elsewhere must not read from the buffer
+        gl_state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    loader->frame.bytes += size;
+    loader->frame.uploads++;
+    loader->frame.stall_seconds += stalled;
+}
+
+static void upload_image_streamed(texture_loader_t * loader, texture_t texture, int level, GLenum internal_format, texture_image_t * image, int allocate) {
+    size_t size = (size_t)image->width * image->height * 4;
+    upload_streamed(loader, texture, level, internal_format, image->width, image->height, image->pixels, size, 0, allocate);
+}
+
+static int has_extension(const char * name) {
+    int count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for(int i = 0; i < count; i++) {
+        if(strcmp((const char *)glGetStringi(GL_EXTENSIONS, i), name) == 0) return 1;
+    }
+    return 0;
+}
+
+int texture_compression_supported(int format, int srgb) {
+    switch(format) {
+        case BC_FORMAT_BC1:
+        case BC_FORMAT_BC3:
+            // The sRGB S3TC formats come from GL_EXT_texture_sRGB, not from the S3TC extension itself
+            return has_extension("GL_EXT_texture_compression_s3tc") && (!srgb || has_extension("GL_EXT_texture_sRGB"));
+        case BC_FORMAT_BC4:
+        case BC_FORMAT_BC5: return 1; // RGTC is core since 3.0
+        case BC_FORMAT_BC7: return has_extension("GL_ARB_texture_compression_bptc");
+        default: return 0;
+    }
+}
+
+void texture_load_image(texture_image_t * image, const char * path) {
+    image->pixels = stbi_load(path, &image->width, &image->height, NULL, 4);
+    if(!image->pixels) panic("Failed to load texture %s: %s\n", path, stbi_failure_reason());
+}
+
+void texture_init(texture_t * texture, const char * path) {
+    texture_image_t image;
+    texture_load_image(&image, path);
+
+    create_texture(texture);
+    upload_image(*texture, &image);
+    texture_image_free(&image);
+}
+
+void texture_delete(texture_t texture) {
+    gl_state_forget_texture(texture);
+    glDeleteTextures(1, &texture);
+}
+
+void texture_decode(texture_image_t * image, const char * name, const unsigned char * data, size_t size) {
+    image->pixels = stbi_load_from_memory(data, (int)size, &image->width, &image->height, NULL, 4);
+    if(!image->pixels) panic("Failed to decode texture %s: %s\n", name, stbi_failure_reason());
+}
+
+void texture_image_free(texture_image_t * image) {
+    stbi_image_free(image->pixels);
+    image->pixels = NULL;
+}
+
+void texture_array_init(texture_array_t * array, int width, int height, int layer_count, int mipmaps, int srgb, allocator_t * a) {
+    array->a = a;
+    array->width = width;
+    array->height = height;
+    array->layer_count = layer_count;
+    array->level_count = mipmaps ? mipmap_level_count(width, height) : 1;
+    array->srgb = srgb;
+    array->used = 0;
+    array->next_free = allocator_alloc(a, layer_count * sizeof(int));
+    if(!array->next_free) panic("Failed to allocate texture array of %d layers\n", layer_count);
+    for(int i = 0; i < layer_count; i++) array->next_free[i] = i + 1 < layer_count ? i + 1 : -1;
+    array->free_head = layer_count > 0 ? 0 : -1;
+
+    glGenTextures(1, &array->texture);
+    gl_state_bind_texture(GL_TEXTURE_2D_ARRAY, array->texture);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, array->level_count - 1);
+
+    GLenum internal_format = srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+    int w = width, h = height;
+    for(int level = 0; level < array->level_count; level++) {
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, level, internal_format, w, h, layer_count, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+}
+
+void texture_array_deinit(texture_array_t * array) {
+    allocator_free_sized(array->a, array->next_free, array->layer_count * sizeof(int));
+    texture_delete(array->texture);
+    array->texture = 0;
+}
+
+int texture_array_add(texture_array_t * array, texture_image_t * image) {
+    int layer = array->free_head;
+    if(layer < 0) return -1;
+    array->free_head = array->next_free[layer];
+    array->next_free[layer] = -2;
+    array->used++;
+
+    texture_array_set(array, layer, image);
+    return layer;
+}
+
+void texture_array_set(texture_array_t * array, int layer, texture_image_t * image) {
+    if(image->width != array->width || image->height != array->height) {
+        panic("Texture of %dx%d does not fit a texture array of %dx%d\n", image->width, image->height, array->width, array->height);
+    }
+
+    mipmap_chain_t chain;
+    if(array->level_count > 1) {
+        mipmap_generate(&chain, image, MIPMAP_FILTER_BOX, array->srgb, array->a);
+    } else {
+        chain.level_count = 1;
+        chain.levels[0] = *image;
+    }
+
+    gl_state_bind_texture(GL_TEXTURE_2D_ARRAY, array->texture);
+    for(int level = 0; level < chain.level_count; level++) {
+        texture_image_t * l = &chain.levels[level];
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, l->width, l->height, 1, GL_RGBA, GL_UNSIGNED_BYTE, l->pixels);
+    }
+
+    if(array->level_count > 1) mipmap_free(&chain);
+}
+
+void texture_array_remove(texture_array_t * array, int layer) {
+    if(layer < 0 || layer >= array->layer_count || array->next_free[layer] != -2) {
+        panic("Removing texture array layer %d which is not in use\n", layer);
+    }
+    array->next_free[layer] = array->free_head;
+    array->free_head = layer;
+    array->used--;
+}
+
+void texture_array_bind(texture_array_t * array, unsigned int unit) {
+    gl_state_bind_texture_unit(unit, GL_TEXTURE_2D_ARRAY, array->texture);
+}
+
+// Worker side, the file contents are not needed once decoded
+static void decode_job(async_io_request_t * request) {
+    texture_job_t * job = request->user;
+    texture_loader_t * loader = job->loader;
+    if(job->compress_format >= 0) {
+        job->cooked = allocator_alloc(loader->a, sizeof(texture_cooked_t));
+        if(!job->cooked) panic("Failed to allocate cooked texture for %s\n", request->path);
+        // The workers already run one texture each, so the encoder stays on this thread
+        texture_cache_cook(job->cooked, job->cache_dir, request->path, (unsigned char *)request->data, request->size, (bc_format_t)job->compress_format, job->generate_mipmaps, (mipmap_filter_t)job->mipmap_filter, job->srgb, 1, loader->a);
+        return;
+    }
+
+    texture_decode(&job->image, request->path, (unsigned char *)request->data, request->size);
+    allocator_free_sized(request->io->a, request->data, request->size + 1);
+    request->data = NULL;
+
+    if(job->generate_mipmaps) {
+        job->mipmaps = allocator_alloc(loader->a, sizeof(mipmap_chain_t));
+        if(!job->mipmaps) panic("Failed to allocate mipmap chain for %s\n", request->path);
+        mipmap_generate(job->mipmaps, &job->image, (mipmap_filter_t)job->mipmap_filter, job->srgb, loader->a);
+    }
+}
+
+static void free_job(texture_loader_t * loader, texture_job_t * job) {
+    if(job->cooked) {
+        texture_cooked_free(job->cooked);
+        allocator_free_sized(loader->a, job->cooked, sizeof(texture_cooked_t));
+    }
+    if(job->mipmaps) {
+        mipmap_free(job->mipmaps);
+        allocator_free_sized(loader->a, job->mipmaps, sizeof(mipmap_chain_t));
+    }
+    texture_image_free(&job->image);
+    allocator_free_sized(loader->a, job, sizeof(texture_job_t));
+}
+
+static void upload_job(texture_loader_t * loader, texture_job_t * job) {
+    if(job->cooked) {
+        texture_cooked_t * cooked = job->cooked;
+        for(int level = 0; level < cooked->level_count; level++) {
+            texture_cooked_level_t * l = &cooked->levels[level];
+            upload_streamed(loader, job->texture, level, cooked->internal_format, l->width, l->height, l->data, l->size, 1, 1);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, cooked->level_count - 1);
+        if(cooked->level_count > 1) glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        return;
+    }
+
+    GLenum internal_format = job->srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+    if(!job->mipmaps) {
+        upload_image_streamed(loader, job->texture, 0, internal_format, &job->image, 1);
+        return;
+    }
+
+    for(int level = 0; level < job->mipmaps->level_count; level++) {
+        upload_image_streamed(loader, job->texture, level, internal_format, &job->mipmaps->levels[level], 1);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, job->mipmaps->level_count - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+}
+
+static void queue_upload(async_io_request_t * request) {
+    texture_job_t * job = request->user;
+    texture_loader_t * loader = job->loader;
+
+    job->next = NULL;
+    if(loader->uploads_tail) loader->uploads_tail->next = job;
+    else loader->uploads_head = job;
+    loader->uploads_tail = job;
+}
+
+void texture_loader_init(texture_loader_t * loader, async_io_t * io, allocator_t * a) {
+    loader->io = io;
+    loader->a = a;
+    loader->uploads_head = NULL;
+    loader->uploads_tail = NULL;
+    loader->in_flight = 0;
+    loader->generate_mipmaps = 0;
+    loader->mipmap_filter = MIPMAP_FILTER_BOX;
+    loader->srgb = 0;
+    loader->compress_format = -1;
+    loader->cache_dir = NULL;
+    memset(loader->pbos, 0, sizeof(loader->pbos));
+    loader->next_pbo = 0;
+    memset(&loader->frame, 0, sizeof(loader->frame));
+    memset(&loader->last_frame, 0, sizeof(loader->last_frame));
+}
+
+void texture_loader_deinit(texture_loader_t * loader) {
+    // Decoded but never uploaded textures keep their placeholder
+    while(loader->uploads_head) {
+        texture_job_t * job = loader->uploads_head;
+        loader->uploads_head = job->next;
+        free_job(loader, job);
+    }
+    loader->uploads_tail = NULL;
+    loader->in_flight = 0;
+
+    for(int i = 0; i < TEXTURE_PBO_RING_SIZE; i++) {
+        texture_pbo_t * pbo = &loader->pbos[i];
+        if(pbo->fence) glDeleteSync(pbo->fence);
+        if(pbo->buffer) {
+            gl_state_forget_buffer(pbo->buffer);
+            glDeleteBuffers(1, &pbo->buffer);
+        }
+    }
+    memset(loader->pbos, 0, sizeof(loader->pbos));
+}
+
+void texture_loader_set_mipmaps(texture_loader_t * loader, int generate_mipmaps, int mipmap_filter, int srgb) {
+    loader->generate_mipmaps = generate_mipmaps;
+    loader->mipmap_filter = mipmap_filter;
+    loader->srgb = srgb;
+    // Turning sRGB on can leave the chosen compression format without an sRGB variant
+    if(loader->compress_format >= 0 && !texture_compression_supported(loader->compress_format, srgb)) loader->compress_format = -1;
+}
+
+int texture_loader_set_compression(texture_loader_t * loader, int compress_format, const char * cache_dir) {
+    if(compress_format >= 0 && !texture_compression_supported(compress_format, loader->srgb)) {
+        loader->compress_format = -1;
+        return 0;
+    }
+    loader->compress_format = compress_format;
+    loader->cache_dir = cache_dir;
+    return 1;
+}
+
+static texture_job_t * new_job(texture_loader_t * loader, texture_t * texture, const char * name) {
+    static const unsigned char placeholder[4] = { 255, 255, 255, 255 };
+
+    create_texture(texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+
+    texture_job_t * job = allocator_alloc(loader->a, sizeof(texture_job_t));
+    if(!job) panic("Failed to allocate texture job for %s\n", name);
+    job->loader = loader;
+    job->texture = *texture;
+    job->generate_mipmaps = loader->generate_mipmaps;
+    job->mipmap_filter = loader->mipmap_filter;
+    job->srgb = loader->srgb;
+    job->compress_format = loader->compress_format;
+    job->cache_dir = loader->cache_dir;
+    job->image.pixels = NULL;
+    job->mipmaps = NULL;
+    job->cooked = NULL;
+    job->next = NULL;
+
+    loader->in_flight++;
+    return job;
+}
+
+void texture_load_async(texture_loader_t * loader, texture_t * texture, const char * path, async_io_priority_t priority) {
+    texture_job_t * job = new_job(loader, texture, path);
+    async_io_read(loader->io, path, priority, &decode_job, &queue_upload, job);
+}
+
+void texture_load_async_memory(texture_loader_t * loader, texture_t * texture, const char * name, const void * data, size_t size, async_io_priority_t priority) {
+    texture_job_t * job = new_job(loader, texture, name);
+    async_io_submit(loader->io, name, data, size, priority, &decode_job, &queue_upload, job);
+}
+
+unsigned int texture_loader_upload(texture_loader_t * loader, double budget_seconds) {
+    double deadline = now_seconds() + budget_seconds;
+    unsigned int uploaded = 0;
+
+    while(loader->uploads_head) {
+        if(uploaded > 0 && now_seconds() >= deadline) break;
+
+        texture_job_t * job = loader->uploads_head;
+        loader->uploads_head = job->next;
+        if(!loader->uploads_head) loader->uploads_tail = NULL;
+
+        upload_job(loader, job);
+        free_job(loader, job);
+
+        loader->in_flight--;
+        uploaded++;
+    }
+
+    return uploaded;
+}
+
+unsigned int texture_loader_pending(texture_loader_t * loader) {
+    return loader->in_flight;
+}
+
+void texture_loader_stream(texture_loader_t * loader, texture_t texture, texture_image_t * image) {
+    upload_image_streamed(loader, texture, 0, GL_RGBA8, image, 0);
+}
+
+void texture_loader_end_frame(texture_loader_t * loader) {
+    loader->last_frame = loader->frame;
+    memset(&loader->frame, 0, sizeof(loader->frame));
+}
+
+texture_upload_stats_t texture_loader_get_stats(texture_loader_t * loader) {
+    return loader->last_frame;
+}
@@ -0,0 +1,172 @@
+#include "texture_cache.h"
+#include "io.h"
+#include "debug.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define CACHE_PATH_LENGTH 1024
+#define CACHE_ALIGNMENT 16
+
+typedef struct cache_header_t cache_header_t;
+typedef struct cache_level_t cache_level_t;
+
+struct cache_header_t {
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint32_t internal_format;
+    uint32_t level_count;
+};
+
+struct cache_level_t {
+    uint32_t width;
+    uint32_t height;
+    uint64_t offset;
+    uint64_t size;
+};
+
+static uint64_t hash_bytes(const unsigned char * data, size_t size, uint64_t hash) {
+    const uint64_t m = 0x9E3779B97F4A7C15ull;
+    size_t i = 0;
+    for(; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * m;
+        hash ^= hash >> 32;
+    }
+    for(; i < size; i++) {
+        hash = (hash ^ data[i]) * m;
+        hash ^= hash >> 32;
+    }
+    hash = (hash ^ size) * m;
+    return hash ^ (hash >> 29);
+}
+
+uint64_t texture_cache_key(const unsigned char * source, size_t source_size, bc_format_t format, int mipmaps, mipmap_filter_t mipmap_filter, int srgb) {
+    // The filter only changes anything when there are mipmaps to build
+    uint32_t filter = mipmaps ? (uint32_t)mipmap_filter : 0;
+    uint32_t settings[5] = { TEXTURE_CACHE_VERSION, (uint32_t)format, (uint32_t)mipmaps, filter, (uint32_t)srgb };
+    uint64_t hash = hash_bytes((const unsigned char *)settings, sizeof(settings), 0xCBF29CE484222325ull);
+    return hash_bytes(source, source_size, hash);
+}
+
+static void cache_path(char * path, const char * cache_dir, uint64_t key) {
+    snprintf(path, CACHE_PATH_LENGTH, "%s/%016llx.btex", cache_dir, (unsigned long long)key);
+}
+
+// Points the levels into the blob, 0 if the blob is not a valid entry for key
+static int parse_blob(texture_cooked_t * cooked, uint64_t key) {
+    if(cooked->blob_size < sizeof(cache_header_t)) return 0;
+
+    cache_header_t header;
+    memcpy(&header, cooked->blob, sizeof(header));
+    if(memcmp(header.magic, "BTEX", 4) != 0 || header.version != TEXTURE_CACHE_VERSION || header.key != key) return 0;
+    if(header.level_count == 0 || header.level_count > MIPMAP_MAX_LEVELS) return 0;
+    if(sizeof(header) + header.level_count * sizeof(cache_level_t) > cooked->blob_size) return 0;
+
+    cooked->internal_format = header.internal_format;
+    cooked->level_count = header.level_count;
+    for(uint32_t i = 0; i < header.level_count; i++) {
+        cache_level_t level;
+        memcpy(&level, cooked->blob + sizeof(header) + i * sizeof(cache_level_t), sizeof(level));
+        if(level.offset > cooked->blob_size || level.size > cooked->blob_size - level.offset) return 0;
+        cooked->levels[i].width = level.width;
+        cooked->levels[i].height = level.height;
+        cooked->levels[i].data = cooked->blob + level.offset;
+        cooked->levels[i].size = level.size;
+    }
+    return 1;
+}
+
+static int load_cached(texture_cooked_t * cooked, const char * path, uint64_t key) {
+    if(access(path, R_OK) != 0) return 0;
+
+    size_t size;
+    cooked->blob = (unsigned char *)read_entire_file_sized(path, &size, cooked->a);
+    cooked->blob_size = size;
+    cooked->blob_allocated = size + 1;
+    if(parse_blob(cooked, key)) return 1;
+
+    allocator_free_sized(cooked->a, cooked->blob, cooked->blob_allocated);
+    cooked->blob = NULL;
+    return 0;
+}
+
+// Written under a temporary name and renamed, so concurrent cooks of the same file never see half an entry
+static void store_cached(texture_cooked_t * cooked, const char * cache_dir, const char * path) {
+    if(mkdir(cache_dir, 0755) != 0 && errno != EEXIST) return;
+
+    char temporary[CACHE_PATH_LENGTH + 64];
+    snprintf(temporary, sizeof(temporary), "%s.%ld.%lx.tmp", path, (long)getpid(), (unsigned long)pthread_self());
+    FILE * f = fopen(temporary, "wb");
+    if(!f) return;
+    size_t written = fwrite(cooked->blob, 1, cooked->blob_size, f);
+    if(fclose(f) != 0 || written != cooked->blob_size || rename(temporary, path) != 0) remove(temporary);
+}
+
+static void cook(texture_cooked_t * cooked, const char * name, const unsigned char * source, size_t source_size, bc_format_t format, int mipmaps, mipmap_filter_t mipmap_filter, int srgb, unsigned int thread_count, uint64_t key) {
+    texture_image_t image;
+    texture_decode(&image, name, source, source_size);
+
+    mipmap_chain_t chain;
+    if(mipmaps) {
+        mipmap_generate(&chain, &image, mipmap_filter, srgb, cooked->a);
+    } else {
+        chain.a = cooked->a;
+        chain.level_count = 1;
+        chain.levels[0] = image;
+    }
+
+    cache_header_t header = { { 'B', 'T', 'E', 'X' }, TEXTURE_CACHE_VERSION, key, bc_gl_format(format, srgb), (uint32_t)chain.level_count };
+    cache_level_t levels[MIPMAP_MAX_LEVELS];
+    size_t offset = sizeof(header) + chain.level_count * sizeof(cache_level_t);
+    for(int i = 0; i < chain.level_count; i++) {
+        offset = (offset + CACHE_ALIGNMENT - 1) & ~(size_t)(CACHE_ALIGNMENT - 1);
+        levels[i].width = chain.levels[i].width;
+        levels[i].height = chain.levels[i].height;
+        levels[i].offset = offset;
+        levels[i].size = bc_image_size(format, chain.levels[i].width, chain.levels[i].height);
+        offset += levels[i].size;
+    }
+
+    cooked->blob_size = offset;
+    cooked->blob_allocated = offset;
+    cooked->blob = allocator_clean_alloc(cooked->a, offset, 1);
+    if(!cooked->blob) panic("Failed to allocate %zu bytes for cooked texture %s\n", offset, name);
+    memcpy(cooked->blob, &header, sizeof(header));
+    memcpy(cooked->blob + sizeof(header), levels, chain.level_count * sizeof(cache_level_t));
+
+    for(int i = 0; i < chain.level_count; i++) {
+        bc_encode(format, &chain.levels[i], cooked->blob + levels[i].offset, thread_count);
+    }
+
+    if(mipmaps) mipmap_free(&chain);
+    texture_image_free(&image);
+
+    parse_blob(cooked, key);
+}
+
+int texture_cache_cook(texture_cooked_t * cooked, const char * cache_dir, const char * name, const unsigned char * source, size_t source_size, bc_format_t format, int mipmaps, mipmap_filter_t mipmap_filter, int srgb, unsigned int thread_count, allocator_t * a) {
+    uint64_t key = texture_cache_key(source, source_size, format, mipmaps, mipmap_filter, srgb);
+    char path[CACHE_PATH_LENGTH];
+    cache_path(path, cache_dir, key);
+
+    cooked->a = a;
+    cooked->blob = NULL;
+    cooked->blob_size = 0;
+    if(load_cached(cooked, path, key)) return 1;
+
+    cook(cooked, name, source, source_size, format, mipmaps, mipmap_filter, srgb, thread_count, key);
+    store_cached(cooked, cache_dir, path);
+    return 0;
+}
+
+void texture_cooked_free(texture_cooked_t * cooked) {
+    allocator_free_sized(cooked->a, cooked->blob, cooked->blob_allocated);
+    cooked->blob = NULL;
+    cooked->level_count = 0;
+}
@@ -0,0 +1,128 @@
+#include "vertex_layout.h"
+#include "debug.h"
+#include <string.h>
+#include <math.h>
+
+typedef struct vertex_format_info_t {
+    int components;
+    GLenum type;
+    GLboolean normalised;
+    size_t size;
+} vertex_format_info_t;
+
+static const vertex_format_info_t formats[VERTEX_FORMAT_COUNT] = {
+    [VERTEX_FORMAT_FLOAT] = { 1, GL_FLOAT, GL_FALSE, 4 },
+    [VERTEX_FORMAT_FLOAT2] = { 2, GL_FLOAT, GL_FALSE, 8 },
+    [VERTEX_FORMAT_FLOAT3] = { 3, GL_FLOAT, GL_FALSE, 12 },
+    [VERTEX_FORMAT_FLOAT4] = { 4, GL_FLOAT, GL_FALSE, 16 },
+    [VERTEX_FORMAT_HALF2] = { 2, GL_HALF_FLOAT, GL_FALSE, 4 },
+    [VERTEX_FORMAT_HALF4] = { 4, GL_HALF_FLOAT, GL_FALSE, 8 },
+    [VERTEX_FORMAT_UNORM8X4] = { 4, GL_UNSIGNED_BYTE, GL_TRUE, 4 },
+    [VERTEX_FORMAT_SNORM8X4] = { 4, GL_BYTE, GL_TRUE, 4 },
+    [VERTEX_FORMAT_UNORM16X2] = { 2, GL_UNSIGNED_SHORT, GL_TRUE, 4 },
+    [VERTEX_FORMAT_SNORM_2_10_10_10] = { 4, GL_INT_2_10_10_10_REV, GL_TRUE, 4 },
+};
+
+// FNV-1a over the locations and formats in order, the offsets follow from them
+static uint64_t hash_attribute(uint64_t hash, const vertex_attribute_t * attribute) {
+    uint32_t words[2] = { attribute->location, (uint32_t)attribute->format };
+    const unsigned char * bytes = (const unsigned char *)words;
+    for(size_t i = 0; i < sizeof(words); i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+void vertex_layout_init(vertex_layout_t * layout) {
+    layout->attribute_count = 0;
+    layout->stride = 0;
+    layout->hash = 0xcbf29ce484222325ull;
+}
+
+void vertex_layout_add(vertex_layout_t * layout, unsigned int location, vertex_format_t format) {
+    if(layout->attribute_count == VERTEX_LAYOUT_MAX_ATTRIBUTES) panic("Vertex layout has more than %d attributes\n", VERTEX_LAYOUT_MAX_ATTRIBUTES);
+    if(format < 0 || format >= VERTEX_FORMAT_COUNT) panic("Unknown vertex format %d\n", format);
+
+    vertex_attribute_t * attribute = &layout->attributes[layout->attribute_count++];
+    attribute->location = location;
+    attribute->format = format;
+    attribute->offset = layout->stride;
+    layout->stride += formats[format].size;
+    layout->hash = hash_attribute(layout->hash, attribute);
+}
+
+int vertex_layout_equal(const vertex_layout_t * layout, const vertex_layout_t * other) {
+    if(layout->hash != other->hash || layout->attribute_count != other->attribute_count) return 0;
+    for(unsigned int i = 0; i < layout->attribute_count; i++) {
+        if(layout->attributes[i].location != other->attributes[i].location) return 0;
+        if(layout->attributes[i].format != other->attributes[i].format) return 0;
+    }
+    return 1;
+}
+
+void vertex_layout_apply(const vertex_layout_t * layout) {
+    for(unsigned int i = 0; i < layout->attribute_count; i++) {
+        const vertex_attribute_t * attribute = &layout->attributes[i];
+        const vertex_format_info_t * info = &formats[attribute->format];
+        glVertexAttribPointer(attribute->location, info->components, info->type, info->normalised, layout->stride, (void *)attribute->offset);
+        glEnableVertexAttribArray(attribute->location);
+    }
+}
+
+size_t vertex_format_size(vertex_format_t format) {
+    return formats[format].size;
+}
+
+uint16_t vertex_pack_half(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint16_t sign = (bits >> 16) & 0x8000;
+    uint32_t exponent = (bits >> 23) & 0xff;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    if(exponent == 0xff) return sign | 0x7c00 | (mantissa ? 0x200 : 0); // infinity or NaN
+    int half_exponent = (int)exponent - 127 + 15;
+    if(half_exponent >= 0x1f) return sign | 0x7c00;
+
+    if(half_exponent <= 0) {
+        // Subnormal, or zero below half the smallest subnormal
+        if(half_exponent < -10) return sign;
+        mantissa |= 0x800000;
+        int shift = 14 - half_exponent;
+        uint32_t half_mantissa = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if(rest > halfway || (rest == halfway && (half_mantissa & 1))) half_mantissa++;
+        return sign | half_mantissa;
+    }
+
+    // Round to nearest even, a carry out of the mantissa correctly bumps the exponent
+    uint32_t half = ((uint32_t)half_exponent << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1fff;
+    if(rest > 0x1000 || (rest == 0x1000 && (half & 1))) half++;
+    return sign | (uint16_t)half;
+}
+
+static uint32_t pack_snorm(float value, float scale, uint32_t mask) {
+    if(value > 1.0f) value = 1.0f;
+    if(value < -1.0f) value = -1.0f;
+    return (uint32_t)(int32_t)lrintf(value * scale) & mask;
+}
+
+uint32_t vertex_pack_normal(float x, float y, float z) {
+    return pack_snorm(x, 511.0f, 0x3ff) | pack_snorm(y, 511.0f, 0x3ff) << 10 | pack_snorm(z, 511.0f, 0x3ff) << 20;
+}
+
+static uint8_t pack_unorm8(float value) {
+    if(value > 1.0f) value = 1.0f;
+    if(value < 0.0f) value = 0.0f;
+    return (uint8_t)lrintf(value * 255.0f);
+}
+
+uint32_t vertex_pack_colour(float r, float g, float b, float a) {
+    uint8_t bytes[4] = { pack_unorm8(r), pack_unorm8(g), pack_unorm8(b), pack_unorm8(a) };
+    uint32_t packed;
+    memcpy(&packed, bytes, sizeof(packed));
+    return packed;
+}